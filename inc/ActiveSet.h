@@ -0,0 +1,139 @@
+/**
+ * @file ActiveSet.h
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+
+#ifndef ACTIVESET_H_
+#define ACTIVESET_H_
+
+// General files
+#include <vector>
+#include <stdint.h>
+
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/vector.hpp>
+
+/* **************************************************************************************
+ * Interface of ActiveSet
+ * **************************************************************************************/
+
+/**
+ * The set of active cells (by index) for the FOLLOW_ACTIVITY iterator. Toppling goes in
+ * waves: the cells that became active during one wave are toppled in the next wave.
+ *
+ * Membership is stored in a bitmap, so Insert and Erase are O(1). A second bitmap marks
+ * the cells that are already queued in the buffer for the next wave, so a cell is never
+ * queued twice and each buffer holds at most "size" indices. The two buffers are swapped
+ * by NextWave and keep their capacity, so after a few avalanches there is no allocation
+ * anymore.
+ */
+class ActiveSet {
+public:
+	//! Constructor ActiveSet for cells with index 0 till size-1
+	ActiveSet(long int size);
+
+	//! Destructor ~ActiveSet
+	virtual ~ActiveSet();
+
+	//! Add cell to the set
+	inline void Insert(long int index) {
+		uint64_t bit = (uint64_t)1 << (index & 63);
+		uint64_t & word = member[index >> 6];
+		if (word & bit) return;
+		word |= bit;
+		++count;
+		uint64_t & queued_word = queued[index >> 6];
+		if (!(queued_word & bit)) {
+			queued_word |= bit;
+			next.push_back(index);
+		}
+	}
+
+	//! Remove cell from the set (it stays queued, but will be skipped in NextWave)
+	inline void Erase(long int index) {
+		uint64_t bit = (uint64_t)1 << (index & 63);
+		uint64_t & word = member[index >> 6];
+		if (!(word & bit)) return;
+		word &= ~bit;
+		--count;
+	}
+
+	//! Check if cell is in the set
+	inline bool Contains(long int index) {
+		return member[index >> 6] & ((uint64_t)1 << (index & 63));
+	}
+
+	//! True if there are no cells in the set
+	inline bool Empty() { return count == 0; }
+
+	//! Number of cells in the set
+	inline long int Size() { return count; }
+
+	//! Move all cells in the set to the returned wave, the set itself is empty afterwards
+	std::vector<long int> & NextWave();
+
+	//! Remove all cells
+	void Clear();
+
+private:
+	//! Serialise using boost, see save and load
+	friend class boost::serialization::access;
+
+	//! Store the cells in the set in the order of the next wave
+	template<class Archive>
+	void save(Archive & ar, const unsigned int version) const {
+		std::vector<long int> cells;
+		for (unsigned int i = 0; i < next.size(); ++i) {
+			if (member[next[i] >> 6] & ((uint64_t)1 << (next[i] & 63))) cells.push_back(next[i]);
+		}
+		ar & cells;
+	}
+
+	//! Replace the cells in the set by the stored ones
+	template<class Archive>
+	void load(Archive & ar, const unsigned int version) {
+		std::vector<long int> cells;
+		ar & cells;
+		Clear();
+		for (unsigned int i = 0; i < cells.size(); ++i) Insert(cells[i]);
+	}
+
+	BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+	//! One bit per cell, set if the cell is in the set
+	std::vector<uint64_t> member;
+
+	//! One bit per cell, set if the cell is in the "next" buffer
+	std::vector<uint64_t> queued;
+
+	//! The wave that is returned by NextWave
+	std::vector<long int> current;
+
+	//! Cells inserted since the last call to NextWave
+	std::vector<long int> next;
+
+	//! Number of cells in the set
+	long int count;
+};
+
+#endif /* ACTIVESET_H_ */
@@ -0,0 +1,218 @@
+/**
+ * @file AvalancheLog.h
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef AVALANCHELOG_H_
+#define AVALANCHELOG_H_
+
+// General files
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+
+#include <Typedefs.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/* **************************************************************************************
+ * Interface of AvalancheLog
+ * **************************************************************************************/
+
+/**
+ * One avalanche: the tick at which the grain was dropped, the cell it was dropped on, the
+ * number of topplings (size), the number of different cells that toppled (area), the number
+ * of waves (duration) and the grains that left the grid or disappeared in the bulk (lost).
+ */
+struct AvalancheRecord {
+	long int tick;
+	long int site;
+	long int size;
+	long int area;
+	long int duration;
+	GrainType lost;
+};
+
+/**
+ * An avalanche log is a binary file with a record per avalanche. It starts with a header:
+ * the 8 characters of LOG_MAGIC, and the width, the height and the resolution of the grains
+ * (the lost grains are stored as an integer number of 1/resolution grain). Every record is a
+ * series of varints, 7 bits per byte, the lowest first, with the highest bit set if another
+ * byte follows: the difference with the tick of the previous record, the site, the size, the
+ * area, the duration and the lost grains (zigzag coded, so a small negative rounding error
+ * stays small). A record of a small avalanche takes about 8 bytes.
+ */
+extern const char LOG_MAGIC[8];
+
+/**
+ * Writes an avalanche log. The records are coded in a buffer, full buffers are written to
+ * the file by a thread of its own, so the simulation does not wait for the disk. Only one
+ * thread should call Write.
+ *
+ * A log can be continued after a restart from a checkpoint: Flush tells how long the log was
+ * at the checkpoint, and the log is cut back to that length when it is opened again, so the
+ * avalanches after the checkpoint are not in it twice.
+ */
+class AvalancheLogWriter {
+public:
+	//! Constructor AvalancheLogWriter, creates the file and writes the header
+	AvalancheLogWriter(const std::string & filename, int width, int height);
+
+	//! Constructor AvalancheLogWriter, continues a log of the given length, see Flush
+	AvalancheLogWriter(const std::string & filename, uint64_t length, long int last_tick);
+
+	//! Destructor ~AvalancheLogWriter, closes the file
+	virtual ~AvalancheLogWriter();
+
+	//! True if the file could be created
+	inline bool IsOpen() { return file != NULL; }
+
+	//! Add a record, the ticks should not decrease
+	void Write(const AvalancheRecord & record);
+
+	//! Write everything that is buffered and wait for it, returns the length of the log
+	uint64_t Flush();
+
+	//! Tick of the last record
+	inline long int GetLastTick() { return last_tick; }
+
+	//! Write everything that is buffered, wait for it and close the file
+	void Close();
+
+private:
+	//! Code a number as varint at the end of the buffer
+	inline void Put(uint64_t value) {
+		while (value >= 0x80) {
+			buffer.push_back((char)(value | 0x80));
+			value >>= 7;
+		}
+		buffer.push_back((char)value);
+	}
+
+	//! Start the writing thread
+	void Start();
+
+	//! Give the buffer to the writing thread
+	void Hand();
+
+	//! Loop of the writing thread
+	void Work();
+
+	//! The file, NULL if it could not be created or is closed
+	FILE *file;
+
+	//! Records that are coded, but not handed to the writing thread yet
+	std::vector<char> buffer;
+
+	//! Buffer that is handed to the writing thread, but not taken yet
+	std::vector<char> pending;
+
+	//! Tick of the previous record
+	long int last_tick;
+
+	//! Number of bytes in the file
+	uint64_t written;
+
+	//! Set while the writing thread writes a buffer
+	bool busy;
+
+	//! Set to let the writing thread return once pending is written
+	bool stop;
+
+	//! Protects pending, written, busy and stop
+	boost::mutex mutex;
+
+	//! Signals a change in pending, busy or stop
+	boost::condition_variable changed;
+
+	//! The writing thread
+	boost::thread *writer;
+};
+
+/**
+ * Reads an avalanche log by mapping the file in memory, so a log of billions of records can
+ * be scanned without reading it in first. Records are decoded one by one with Next. A record
+ * that is cut off (e.g. by a crash) ends the log.
+ */
+class AvalancheLogReader {
+public:
+	//! Constructor AvalancheLogReader, maps the file and reads the header
+	AvalancheLogReader(const std::string & filename);
+
+	//! Destructor ~AvalancheLogReader, unmaps the file
+	virtual ~AvalancheLogReader();
+
+	//! True if the file could be mapped and has a valid header
+	inline bool IsOpen() { return data != NULL; }
+
+	//! Width of the grid
+	inline int GetWidth() { return width; }
+
+	//! Height of the grid
+	inline int GetHeight() { return height; }
+
+	//! Decode the next record, returns false at the end of the log
+	bool Next(AvalancheRecord & record);
+
+	//! Start again at the first record
+	void Rewind();
+
+private:
+	//! Decode a varint at the current position, returns false if it is cut off
+	inline bool Get(uint64_t & value) {
+		value = 0;
+		for (int shift = 0; (position < size) && (shift < 64); shift += 7) {
+			unsigned char byte = data[position++];
+			value |= (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return true;
+		}
+		return false;
+	}
+
+	//! The mapped file, NULL if it could not be mapped
+	const unsigned char *data;
+
+	//! Size of the file
+	size_t size;
+
+	//! Position of the first record
+	size_t begin;
+
+	//! Position of the next record
+	size_t position;
+
+	//! Tick of the previous record
+	long int last_tick;
+
+	//! Width of the grid
+	int width;
+
+	//! Height of the grid
+	int height;
+
+	//! The lost grains are stored in 1/resolution grain
+	uint64_t resolution;
+};
+
+#endif /* AVALANCHELOG_H_ */
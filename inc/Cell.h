@@ -27,9 +27,9 @@
 
 // General files
 #include <boost/function.hpp>
-#include <boost/random/mersenne_twister.hpp>
 
 #include <Typedefs.h>
+#include <HeightHistogram.hpp>
 
 /* **************************************************************************************
  * Forward declarations and typedefs
@@ -38,10 +38,8 @@
 //#include <TestCell.h>
 class TestCell;
 
-class Cell;
-
-//! The callback function
-typedef boost::function<void(Cell&)> AlteredCallback;
+//! The observer of changes in height, called with the index of the cell in the grid
+typedef boost::function<void(long int)> AlteredCallback;
 
 /* **************************************************************************************
  * Interface of Cell
@@ -51,85 +49,91 @@ typedef boost::function<void(Cell&)> AlteredCallback;
 enum Direction { NORTH, WEST, SOUTH, EAST };
 
 /**
- * A cell can either decrease or increase height.
+ * A cell can either decrease or increase height. The cell does not own its data. The
+ * heights, directions and capacities are stored in separate contiguous arrays in the Grid
+ * and a Cell is only a thin view on one index in those arrays. Create it by Grid::GetCell
+ * and do not keep it around longer than the grid itself. The type of the height is the
+ * template parameter T, see HeightType. A change in height is added to the running total
+ * of grains of the grid (not for the reservoir), and to the height histogram of the grid if it
+ * keeps one.
  */
-//template <typename GrainType>
+template <typename T>
 class Cell {
 public:
-	//! Constructor Cell
-	Cell();
-
-	//! Destructor ~Cell
-	virtual ~Cell();
+	//! Constructor Cell, a view on the given index of the arrays
+	Cell(T *height, unsigned char *direction, T *max_capacity, long int id,
+			const AlteredCallback *altered_function, GrainType *grains,
+			HeightHistogram<T> *histogram):
+		height(height), direction(direction), max_capacity(max_capacity), id(id),
+		altered_function(altered_function), grains(grains), histogram(histogram) { }
 
 	//! Set maximum capacity per cell
-	inline void SetMaxCapacity(GrainType c) { max_capacity = c; }
+	inline void SetMaxCapacity(T c) { *max_capacity = c; }
 
 	//! Get maximum capacity per cell
-	inline GrainType GetMaxCapacity() { return max_capacity; }
+	inline T GetMaxCapacity() { return *max_capacity; }
 
 	//! The "height" of a cell, the number of sand particles in SOC models
-	inline GrainType GetHeight() { return height; }
+	inline T GetHeight() { return *height; }
 
 	//! Decrease pile height
-	inline void Decrease(const GrainType number) {
-		height -= number; if (altered_function != NULL) altered_function(*this);
+	inline void Decrease(const T number) {
+		T before = *height;
+		*height -= number; Altered(before, -(GrainType)number);
 	}
 
 	//! Increase pile height
-	inline void Increase(const GrainType number) {
-		height += number; if (altered_function != NULL) altered_function(*this);
+	inline void Increase(const T number) {
+		T before = *height;
+		*height += number; Altered(before, number);
 	}
 
 	//! Move number of grains from one cell to another, actual number will be returned
-	GrainType Transfer(Cell &cell, GrainType number);
+	T Transfer(Cell cell, T number);
 
 	//! Remove all items
 	inline void Clear() {
-		height = 0; if (altered_function != NULL) altered_function(*this);
+		T before = *height;
+		*height = 0; Altered(before, -(GrainType)before);
 	}
 
 	//! Get direction
-	inline int GetDirection() { return direction; }
+	inline int GetDirection() { return *direction; }
 
 	//! Set direction
-	inline void SetDirection(int direction) { this->direction = direction; }
-
-	//! An identifier, necessary to go from Cell to location in a Grid
-	inline void SetId(long int id) { this->id = id; }
+	inline void SetDirection(int direction) { *this->direction = direction; }
 
-	//! Get the identifier
+	//! Get the identifier, this is the index of the cell in the grid
 	inline long int GetId() { return id; }
 
-	//! Set callback function that is called as soon as pile height increases or decreases
-	inline void SetAlteredFunction(AlteredCallback func) { altered_function = func; }
-
-public:
-	//! Set feed for neighbour order and dissipation
-	inline static void SetDirectionFeed(int feed) { direction_feed = feed; }
-
-	//! Get feed for grid for Boost randomizer
-	inline static int GetDirectionFeed() { return direction_feed; }
-
 private:
-
-	//! Increased or decreased...
-	AlteredCallback altered_function;
+	//! Update the total and the histogram of the grid and call the observer if there is one
+	inline void Altered(T before, GrainType change) {
+		if (grains != NULL) *grains += change;
+		if (histogram != NULL) histogram->Move(before, *height);
+		if ((altered_function != NULL) && (*altered_function != NULL)) (*altered_function)(id);
+	}
 
 	//! The number of items in the cell
-	GrainType height;
+	T *height;
 
 	//! Direction can be north, east, south, west
-	int direction;
+	unsigned char *direction;
 
 	//! Maximum number of grains in a cell
-	GrainType max_capacity;
+	T *max_capacity;
 
-	//! The identifier (set externally with SetId)
+	//! The identifier (index in the grid)
 	long int id;
 
-	//! Feed for direction
-	static int direction_feed;
+	//! Increased or decreased... (owned by the grid, NULL for the reservoir)
+	const AlteredCallback *altered_function;
+
+	//! Running total of grains of the grid (owned by the grid, NULL for the reservoir)
+	GrainType *grains;
+
+	//! Height histogram of the grid (owned by the grid, NULL if not kept or for the reservoir)
+	HeightHistogram<T> *histogram;
 
 	//! Only a testing function is allowed to reach private fields
 	friend class TestCell;
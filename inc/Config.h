@@ -31,7 +31,9 @@
 
 // Allow for serialisation of map and vector
 #include <boost/serialization/map.hpp>
+#include <boost/serialization/string.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
 
 #include <string.h>
 #include <Toppling.h>
@@ -113,11 +115,38 @@ public:
     	ar & toppling_threshold;
         ar & run_experiment;
         ar & run_id;
+        if (version > 0) ar & height_type;
+        else height_type = HT_DOUBLE;
+        if (version > 1) ar & no_threads;
+        else no_threads = 1;
+        if (version > 2) ar & tiled;
+        else tiled = false;
+        if (version > 3) ar & no_trial_threads;
+        else no_trial_threads = 1;
+        if (version > 4) ar & avalanche_log;
+        else avalanche_log = false;
+        if (version > 5) ar & checkpoint_interval;
+        else checkpoint_interval = 0;
+        if (version > 6) ar & state_cache;
+        else state_cache = "";
+        if (version > 7) ar & auto_skip;
+        else auto_skip = false;
+        if (version > 8) ar & synchronous;
+        else synchronous = false;
+        if (version > 9) ar & grid_layout;
+        else grid_layout = GL_ROW_MAJOR;
+        if (version > 10) ar & page_type;
+        else page_type = PT_NORMAL;
+        if (version > 10) ar & first_touch;
+        else first_touch = false;
     }
 
 	//! Get toppling method in the form of a string
 	std::string & GetTopplingMethod();
 
+	//! Hash of the fields that determine the stationary state, as hexadecimal string
+	std::string GetStateKey();
+
 	//! Print to console
 	void Print();
 
@@ -178,6 +207,44 @@ public:
 
 	//! ID for run
 	int run_id;
+
+	//! Type in which the heights are stored (version 1)
+	HeightType height_type;
+
+	//! Number of threads that topple large waves of an avalanche together (version 2)
+	int no_threads;
+
+	//! Decompose the grid in a tile per thread, for very large grids (version 3)
+	bool tiled;
+
+	//! Number of threads that run trials at the same time (version 4)
+	int no_trial_threads;
+
+	//! Write every avalanche to a binary log per trial in the run directory (version 5)
+	bool avalanche_log;
+
+	//! Ticks between checkpoints in the run directory, 0 for none (version 6)
+	long int checkpoint_interval;
+
+	//! Directory with sandpiles after the skipped ticks, empty for none (version 7)
+	std::string state_cache;
+
+	//! Skip ticks till the grains per cell are stationary, rather than "skip" (version 8)
+	bool auto_skip;
+
+	//! Topple all unstable cells at the same time, step by step, for BTW only (version 9)
+	bool synchronous;
+
+	//! Order of the cells in memory, row by row or in tiles (version 10)
+	GridLayout grid_layout;
+
+	//! Pages that back the arrays of the grids, normal or huge (version 11)
+	PageType page_type;
+
+	//! Touch the bands of rows of the no_threads toppling threads with a thread each (version 11)
+	bool first_touch;
 };
 
+BOOST_CLASS_VERSION(Config, 11)
+
 #endif /* CONFIG_H_ */
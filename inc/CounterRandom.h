@@ -0,0 +1,132 @@
+/**
+ * @file CounterRandom.h
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef COUNTERRANDOM_H_
+#define COUNTERRANDOM_H_
+
+// General files
+#include <stdint.h>
+
+/* **************************************************************************************
+ * Interface of CounterRandom
+ * **************************************************************************************/
+
+/**
+ * A counter-based random generator, Philox4x32-10 (Salmon et al., "Parallel random numbers:
+ * as easy as 1, 2, 3", 2011). It has no state except a key, here the feed and the stream of
+ * a simulation. A counter of four words is mapped to four random words, and the same counter
+ * always gives the same words. So random numbers can be tied to an event, e.g. the k-th
+ * toppling of cell i, instead of to the order in which a thread draws them.
+ *
+ * Many blocks can be made at once with Blocks, a loop without dependencies between the
+ * blocks that the compiler can vectorize. For a plain sequence of random words, there is a
+ * buffer that is filled in bulk, see Next.
+ */
+class CounterRandom {
+public:
+	//! Constructor CounterRandom with key (0,0)
+	CounterRandom();
+
+	//! Destructor ~CounterRandom
+	virtual ~CounterRandom();
+
+	//! Set key, the sequence of Next starts again
+	void SetKey(uint32_t seed, uint32_t stream);
+
+	//! Four random words for the counter (c0,c1,c2,c3)
+	inline void Block(uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3, uint32_t *out) const {
+		uint32_t k0 = key[0], k1 = key[1];
+		for (int r = 0; r < ROUNDS; ++r) {
+			Round(c0, c1, c2, c3, k0, k1);
+		}
+		out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+	}
+
+	//! Blocks for the counters (c0[i],c1[i],c2,c3), word j of block i goes to out[j*n+i]
+	void Blocks(const uint32_t *c0, const uint32_t *c1, uint32_t c2, uint32_t c3, long int n,
+			uint32_t *out) const;
+
+	//! Next random word of the sequence of this key
+	inline uint32_t Next() {
+		if (index == BUFFER_SIZE) Refill();
+		return buffer[index++];
+	}
+
+	//! Number of words taken from the sequence so far
+	inline uint64_t GetPosition() const { return position * BUFFER_SIZE + index - BUFFER_SIZE; }
+
+	//! Continue the sequence at the given number of words
+	void SetPosition(uint64_t words);
+
+	//! Uniform number in (0,1) from a random word
+	static inline double Uniform(uint32_t word) {
+		return (word + 0.5) * (1.0 / 4294967296.0);
+	}
+
+	//! Number from 0 till n-1 from a random word (multiply and shift, no division)
+	static inline uint32_t Below(uint32_t word, uint32_t n) {
+		return (uint32_t)(((uint64_t)word * n) >> 32);
+	}
+
+private:
+	//! Number of rounds, 10 is the default of Philox4x32
+	static const int ROUNDS = 10;
+
+	//! Words in the buffer of Next, four per block
+	static const int BUFFER_SIZE = 1024;
+
+	//! One Philox round, and the next round key
+	static inline void Round(uint32_t & c0, uint32_t & c1, uint32_t & c2, uint32_t & c3,
+			uint32_t & k0, uint32_t & k1) {
+		uint64_t p0 = (uint64_t)0xD2511F53 * c0;
+		uint64_t p1 = (uint64_t)0xCD9E8D57 * c2;
+		uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t)p1;
+		c3 = (uint32_t)p0;
+		c0 = n0;
+		c2 = n2;
+		k0 += 0x9E3779B9;
+		k1 += 0xBB67AE85;
+	}
+
+	//! Fill the buffer with the next blocks of the sequence
+	void Refill();
+
+	//! Key: the feed and the stream
+	uint32_t key[2];
+
+	//! Number of times the buffer has been filled
+	uint64_t position;
+
+	//! Next word in the buffer
+	int index;
+
+	//! Words of the sequence
+	uint32_t buffer[BUFFER_SIZE];
+
+	//! Counters for Refill
+	uint32_t counters[2][BUFFER_SIZE/4];
+};
+
+#endif /* COUNTERRANDOM_H_ */
@@ -55,7 +55,7 @@ public:
 	inline void SetType(DataType dataType) { this->dataType = dataType; }
 
 	//! Point towards data in the form of a map
-	inline void SetData(std::map<DataDecoratorType,int> & data) { this->map_data = &data; dataType = DT_MAP; }
+	inline void SetData(std::map<DataDecoratorType,double> & data) { this->map_data = &data; dataType = DT_MAP; }
 
 	//! Point towards data in the form of an array
 	inline void SetData(float *data, int len) { float_data = data; float_data_len = len; dataType = DT_F2DARRAY; }
@@ -94,7 +94,7 @@ private:
 	DataType dataType;
 
 	//! Data in the form of a map
-	std::map<DataDecoratorType,int> * map_data;
+	std::map<DataDecoratorType,double> * map_data;
 
 	//! An array of data
 	float *float_data;
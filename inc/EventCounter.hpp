@@ -46,19 +46,19 @@ public:
 
 	//! Add one event of given type
 	void AddEvent(const T type) {
-		typename std::map<T,int>::iterator f = events.find(type);
+		typename std::map<T,long int>::iterator f = events.find(type);
 		if (f == events.end()) {
-			events.insert(std::make_pair<T,int>(type, 1));
+			events.insert(std::make_pair(type, 1L));
 		} else {
 			(*f).second++;
 		}
 	}
 
 	//! Add "freq" events of a given type
-	void AddEvent(const T type, int freq) {
-		typename std::map<T,int>::iterator f = events.find(type);
+	void AddEvent(const T type, long int freq) {
+		typename std::map<T,long int>::iterator f = events.find(type);
 		if (f == events.end()) {
-			events.insert(std::make_pair<T,int>(type, freq));
+			events.insert(std::make_pair(type, freq));
 		} else {
 			(*f).second += freq;
 		}
@@ -66,7 +66,7 @@ public:
 
 	//! Take the existing events and put them in bins
 	void Bin(int no_bins, T min, T max) {
-		typename std::map<T,int>::iterator f;
+		typename std::map<T,long int>::iterator f;
 		if (events.empty()) return;
 		EventCounter binned_cntr;
 
@@ -96,7 +96,7 @@ public:
 
 	//! Print
 	void Print(int print_list = 0) {
-		typename std::map<T,int>::iterator f;
+		typename std::map<T,long int>::iterator f;
 
 		int line_items = 20; int i = 0;
 
@@ -127,10 +127,10 @@ public:
 	}
 
 	//! Get events
-	std::map<T, int> & getEvents() { return events; }
+	std::map<T, long int> & getEvents() { return events; }
 private:
 	//! Probably a sparse vector is the best, but to stay in STL, we will use a map
-	std::map<T, int> events;
+	std::map<T, long int> events;
 };
 
 #endif /* EVENTCOUNTER_H_ */
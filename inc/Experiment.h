@@ -29,12 +29,17 @@
 #include <map>
 #include <string>
 
+#include <AvalancheLog.h>
 #include <Config.h>
-#include <EventCounter.hpp>
+#include <LogHistogram.hpp>
 #include <PlotFigure.h>
 #include <SandPile.h>
+#include <SimulationContext.h>
+#include <Stationarity.h>
 #include <Time.h>
 
+#include <boost/thread/mutex.hpp>
+
 /* **************************************************************************************
  * Interface of Experiment
  * **************************************************************************************/
@@ -42,7 +47,15 @@
 typedef double CounterType;
 
 /**
- * Do the experiment and plot what is necessary.
+ * Do the experiment and plot what is necessary. The trials can run at the same time, each
+ * in its own thread with its own sandpile and random streams, see RunParallel.
+ *
+ * If the trials run one after the other, the experiment can store a checkpoint in the run
+ * directory every so many ticks. A run that is started again continues from there.
+ *
+ * With a state cache, the sandpile after the skipped ticks is stored under a key of the
+ * configuration (see Config::GetStateKey). Later trials and runs with the same key start
+ * from that sandpile at the first measured tick, rather than from an empty one.
  */
 class Experiment {
 public:
@@ -55,23 +68,59 @@ public:
 	//! Run once
 	bool Run();
 protected:
-	//! A run exists out of a number of trials
-	void Trial(int trial);
+	//! Experiment for a single trial of RunParallel, to be created in the thread that runs it
+	Experiment(Config & cfg, int trial);
+
+	//! A run exists out of a number of trials, a trial can continue at a given tick
+	void Trial(int trial, long int start = 0);
 
 	//! A trial exists out of a number of ticks
 	void Tick(long int t);
 
 	//! Plot at the end of a run
 	void Plot();
+
+	//! Run the trials on several threads and add up the counters of all trials
+	void RunParallel();
+
+	//! Thread of RunParallel, it runs trials till there are no trials left
+	void Work();
 private:
+	//! Create the sandpile according to the configuration
+	void CreateSandPile();
+
+	//! Create the counters for the figures
+	void CreateCounters();
+
+	//! Name of the checkpoint file in the run directory
+	std::string CheckpointFile();
+
+	//! Store the state of the run, the trial continues at the given tick
+	void StoreCheckpoint(int trial, long int t);
+
+	//! Continue from the checkpoint, returns false if it does not fit the configuration
+	bool LoadCheckpoint(int & trial, long int & t);
+
+	//! Name of the file in the state cache for the configuration
+	std::string StateFile();
+
+	//! Store the sandpile after the skipped ticks in the state cache, if it is not there yet
+	void StoreState(int trial);
+
+	//! Start from the sandpile in the state cache, returns false if there is none
+	bool LoadState();
+
 	//! Store all the configuration options
 	Config & config;
 
+	//! The random generators of the sandpile of this experiment (or of this trial)
+	SimulationContext context;
+
 	//! We use a sandpile in this experiment
-	SandPile *sandpile;
+	SandPileBase *sandpile;
 
 	//! Map with different types to plots to make
-	std::map<PlotFigureType,EventCounter<CounterType>*> counters;
+	std::map<PlotFigureType,LogHistogram<CounterType>*> counters;
 
 	//! Create timer to time trial
 	Time timer;
@@ -82,6 +131,34 @@ private:
 	//! Wrapper around Plot
 	PlotFigure plot_figure;
 
+	//! Show the progress of a trial with dots
+	bool show_progress;
+
+	//! Draw pictures of the sandpile during a trial
+	bool draw_pictures;
+
+	//! The next trial to run in RunParallel
+	int next_trial;
+
+	//! Protects next_trial, the counters and the console in RunParallel
+	boost::mutex mutex;
+
+	//! Log of the avalanches of the current trial, NULL if not asked for
+	AvalancheLogWriter *avalanche_log;
+
+	//! Store checkpoints during the trials (only if they run one after the other)
+	bool checkpoints;
+
+	//! Length and last tick of the avalanche log at the checkpoint that is continued
+	uint64_t log_length;
+	long int log_tick;
+
+	//! Last tick that is skipped in the current trial (config.skip, or found by stationarity)
+	long int skip;
+
+	//! Finds the end of the transient in the grains per cell, see auto_skip
+	Stationarity stationarity;
+
 };
 
 #endif /* EXPERIMENT_H_ */
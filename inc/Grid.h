@@ -27,7 +27,13 @@
 
 // General files
 #include <vector>
+#include <algorithm>
 #include <Cell.h>
+#include <SimulationContext.h>
+#include <GridAllocator.h>
+
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/array.hpp>
 
 /**
  * The different possible boundary types. The "undefined" can also be seen as the "default"
@@ -48,11 +54,32 @@
 enum BoundaryType { BT_UNDEFINED, BT_PERIODIC, BT_DISSIPATING, BT_WALL_DISSIPATING,
 	BT_CIRCULAR, BT_RANDOM_NEIGHBOURS, BT_FULLY_CONNECTED };
 
+/**
+ * The order in which the cells are stored in the arrays of the grid.
+ * <ul>
+ * <li>GL_ROW_MAJOR				row by row, the cell at (i,j) has index j*width+i
+ * <li>GL_TILED					tiles of 64x64 cells after each other, row by row within a
+ * 								tile, and the tiles row by row as well (the tiles at the
+ * 								right and bottom border can be smaller)
+ * </ul>
+ */
+enum GridLayout { GL_ROW_MAJOR, GL_TILED };
+
 /**
  * Make it easy to use boundary type in (stdout) streams.
  */
 std::ostream& operator<<( std::ostream& os, const BoundaryType& type );
 
+/**
+ * Make it easy to use height type in (stdout) streams.
+ */
+std::ostream& operator<<( std::ostream& os, const HeightType& type );
+
+/**
+ * Make it easy to use grid layout in (stdout) streams.
+ */
+std::ostream& operator<<( std::ostream& os, const GridLayout& layout );
+
 /* **************************************************************************************
  * Interface of Grid
  * **************************************************************************************/
@@ -60,17 +87,53 @@ std::ostream& operator<<( std::ostream& os, const BoundaryType& type );
 /**
  * A 2-dimensional sand_grid, the terms "width" and "height" refer to the dimensions of the
  * sand_grid. The tiles are squares and each sand_grid cell is connected to four neighbours.
+ *
+ * GridBase contains everything that does not depend on the type of the heights: the
+ * dimensions, the boundary, the directions and the neighbours. Grid<T> adds the heights
+ * and the capacities.
+ *
+ * The neighbours of all cells are calculated once at construction and stored in a flat
+ * table (compressed-row style: an offset per cell into one array of indices), so toppling
+ * does not need to calculate them again and again. The reservoir is a neighbour like any
+ * other cell, by its index. Only BT_FULLY_CONNECTED draws new neighbours each time.
+ *
+ * The random neighbours and the directions are drawn from the generators of the simulation
+ * context of the grid. The toppling procedure on the grid uses the same context.
+ *
+ * Which cell has which index depends on the layout, see GridLayout. Avalanches spread in
+ * compact blobs, and with tiles the cells above and below are mostly within the same few
+ * pages of memory, rather than a full row apart. Use GetIndex and GetCoordinates to go from
+ * coordinates to indices and back, only the row by row layout allows for arithmetic on the
+ * indices.
+ *
+ * The arrays are allocated by the given allocator, on normal or on huge pages, and with
+ * more than one band each band of rows is touched first by a thread of its own, see
+ * GridAllocator. The bands are the same as the ones of the toppling threads.
  */
-class Grid {
+class GridBase {
 public:
-	//! Constructor Grid
-	Grid(int width, int height, BoundaryType boundary_type);
+	//! Constructor GridBase
+	GridBase(int width, int height, BoundaryType boundary_type, SimulationContext & context,
+			GridLayout layout = GL_ROW_MAJOR, const GridAllocator & allocator = GridAllocator());
 
-	//! Destructor ~Grid
-	virtual ~Grid();
+	//! Destructor ~GridBase
+	virtual ~GridBase();
+
+	//! Get indices of the neighbours of given cell, the reservoir can be one of them
+	void GetNeighbours(int i, int j, std::vector<long int> & neighbours);
 
-	//! Get neighbours of given cell, sand_grid is defined periodically
-	void GetNeighbours(int i, int j, std::vector<Cell*> & neighbours);
+	//! Get number of neighbours of cell with given index, and a pointer to their indices
+	inline int GetNeighbours(long int n, const long int * & neighbours) {
+		if (neighbour_offsets == NULL) return GetRandomNeighbours(n, neighbours);
+		neighbours = &neighbour_table[neighbour_offsets[n]];
+		return neighbour_offsets[n+1] - neighbour_offsets[n];
+	}
+
+	//! Get neighbours of cell with given index for boundary type B, see the specialisations
+	template <BoundaryType B>
+	inline int GetNeighbours(long int n, const long int * & neighbours, long int * /*scratch*/) {
+		return GetNeighbours(n, neighbours);
+	}
 
 	//! Width
 	inline int GetWidth() { return width; }
@@ -78,49 +141,306 @@ public:
 	//! PFT_Height
 	inline int GetHeight() { return height; }
 
-	//! Total number of grains
-	GrainType CountGrains();
+	//! Number of cells (without the reservoir)
+	inline long int GetSize() { return size; }
 
-	//! Return cell given coordinates
-	Cell & GetCell(int i, int j);
+	//! Index of the reservoir in the arrays
+	inline long int GetReservoir() { return size; }
 
-	//! Return cell by index
-	Cell & GetCell(int n);
+	//! Type of boundary
+	inline BoundaryType GetBoundaryType() { return boundary_type; }
 
-	//! Print content of every cell
-	void Print();
+	//! Order of the cells in the arrays
+	inline GridLayout GetLayout() { return layout; }
+
+	//! Index of the cell in column i and row j
+	inline long int GetIndex(int i, int j) {
+		if (layout == GL_ROW_MAJOR) return (long int)j * width + i;
+		int ti = i / TileSide, tj = j / TileSide;
+		int band_height = std::min(TileSide, height - tj * TileSide);
+		int tile_width = std::min(TileSide, width - ti * TileSide);
+		return ((long int)tj * width + (long int)ti * band_height) * TileSide +
+				(j - tj * TileSide) * tile_width + (i - ti * TileSide);
+	}
+
+	//! Row of the cell with the given index row by row, a multiplication instead of a division
+	inline long int GetRow(long int n) {
+		long int j = (long int)(n * inverse_width);
+		long int i = n - j * width;
+		if (i < 0) return j - 1;
+		if (i >= width) return j + 1;
+		return j;
+	}
+
+	//! Column i and row j of the cell with the given index (not the reservoir)
+	inline void GetCoordinates(long int n, int & i, int & j) {
+		if (layout == GL_ROW_MAJOR) {
+			j = GetRow(n);
+			i = n - (long int)j * width;
+			return;
+		}
+		int tj = n / ((long int)TileSide * width);
+		long int offset = n - (long int)tj * TileSide * width;
+		int band_height = std::min(TileSide, height - tj * TileSide);
+		int ti = offset / ((long int)TileSide * band_height);
+		offset -= (long int)ti * TileSide * band_height;
+		int tile_width = std::min(TileSide, width - ti * TileSide);
+		j = tj * TileSide + offset / tile_width;
+		i = ti * TileSide + offset % tile_width;
+	}
+
+	//! Array with the directions of all cells (plus the reservoir at the end)
+	inline unsigned char *GetDirections() { return directions; }
+
+	//! Size in bytes of the pages that back the largest array of the grid
+	inline size_t GetPageSize() { return allocator.GetPageSize(); }
+
+	//! Number of bands of rows the arrays are first touched in, see GridAllocator::Pin
+	inline int GetBands() { return allocator.GetBands(); }
 
 	//! Within largest circle
 	bool WithinCircle(int i, int j);
 
-	//! Set feed for random neighbours
-	inline static void SetNeighbourFeed(int feed) { neighbour_feed = feed; }
+	//! The simulation context with the random generators
+	inline SimulationContext & GetContext() { return *context; }
 
-	//! Get feed for random neighbours
-	inline static int GetNeighbourFeed() { return neighbour_feed; }
+protected:
+	//! Serialise using boost, the neighbour table is made again on construction
+	friend class boost::serialization::access;
+
+	//! Store or load the directions and the shuffled indices, the size has to be the same
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version) {
+		ar & boost::serialization::make_array(directions, size+1);
+		ar & boost::serialization::make_array(random_indices, size);
+	}
 
-private:
 	//! Width of the grid
 	int width;
 
 	//! Height of the grid
 	int height;
 
-	//! Use 1-dimensional array for 2-dimensional grid
-	Cell *cells;
+	//! One over the width, see GetRow
+	double inverse_width;
+
+	//! Number of cells, width*height
+	long int size;
+
+	//! Direction per cell (north, east, south, west), the reservoir is at index size
+	unsigned char *directions;
 
 	//! Type of boundary (periodic, or removing/dissipating)
 	BoundaryType boundary_type;
 
-	//! Reservoir is just one cell outside of the grid
-	Cell reservoir;
+	//! Order of the cells in the arrays
+	GridLayout layout;
+
+	//! Number of rows and columns of a tile in the GL_TILED layout
+	static const int TileSide = 64;
+
+	//! Simulation context, not owned by the grid
+	SimulationContext *context;
+
+	//! Allocates the arrays of the grid
+	GridAllocator allocator;
+
+	//! First index of every band of rows of the allocator, the last item is size+1
+	std::vector<long int> bands;
+
+private:
+	//! Divide the rows in bands for the allocator, like Toppling::SetThreads
+	void CreateBands();
+
+	//! Fill the neighbour table for all cells
+	void CreateNeighbourTable();
+
+	//! Draw four new random neighbours (BT_FULLY_CONNECTED)
+	int GetRandomNeighbours(long int n, const long int * & neighbours);
+
+	//! Draw a random direction for a new cell
+	unsigned char RandomDirection();
 
 	//! An array with indices that is randomly shuffled once, or all the time
-	int *random_indices;
+	long int *random_indices;
+
+	//! Per cell the offset in the neighbour table, the last item is the table size
+	long int *neighbour_offsets;
+
+	//! The indices of the neighbours of all cells after each other
+	long int *neighbour_table;
+
+	//! Scratch space for neighbours that are drawn each time
+	long int random_neighbours[4];
+};
+
+/**
+ * On a periodic lattice the neighbours are calculated on the fly in the same order as in the
+ * table (north, west, south, east), without the memory traffic of the table. That is only
+ * possible row by row, with tiles the table is used.
+ */
+template <>
+inline int GridBase::GetNeighbours<BT_PERIODIC>(long int n, const long int * & neighbours,
+		long int *scratch) {
+	if (layout != GL_ROW_MAJOR) return GetNeighbours(n, neighbours);
+	long int j = GetRow(n), i = n - j * width;
+	scratch[NORTH] = (j > 0) ? n - width : n + size - width;
+	scratch[WEST] = (i > 0) ? n - 1 : n + width - 1;
+	scratch[SOUTH] = (j < height - 1) ? n + width : i;
+	scratch[EAST] = (i < width - 1) ? n + 1 : n - width + 1;
+	neighbours = scratch;
+	return 4;
+}
+
+/**
+ * Same for the dissipating boundary, again in the order of the table (west, east, north,
+ * south), the reservoir takes the place of neighbours outside the grid.
+ */
+template <>
+inline int GridBase::GetNeighbours<BT_DISSIPATING>(long int n, const long int * & neighbours,
+		long int *scratch) {
+	if (layout != GL_ROW_MAJOR) return GetNeighbours(n, neighbours);
+	long int j = GetRow(n), i = n - j * width;
+	scratch[0] = (i > 0) ? n - 1 : size;
+	scratch[1] = (i < width - 1) ? n + 1 : size;
+	scratch[2] = (j > 0) ? n - width : size;
+	scratch[3] = (j < height - 1) ? n + width : size;
+	neighbours = scratch;
+	return 4;
+}
+
+/**
+ * In the fully connected case there is no table, the neighbours are drawn each time.
+ */
+template <>
+inline int GridBase::GetNeighbours<BT_FULLY_CONNECTED>(long int n, const long int * & neighbours,
+		long int * /*scratch*/) {
+	return GetRandomNeighbours(n, neighbours);
+}
+
+/**
+ * The cells are not stored as objects, but as a structure of arrays: the heights, the
+ * directions and the capacities each have their own contiguous array. The toppling routines
+ * go through these arrays by index. The reservoir is stored at the end of the arrays, at
+ * index GetReservoir(). A Cell is only a view on one index in these arrays.
+ *
+ * The heights are of type T. There are explicit instantiations for uint8_t, int32_t, float
+ * and double. The grid does not know about active cells, that is up to the toppling
+ * procedure. An observer can be set for tests and debugging, it is not needed otherwise.
+ * Note that the reservoir collects all grains that leave the grid, so with small integer
+ * types its height wraps around: do not use it as a counter.
+ *
+ * The grid keeps a running total of its grains, so the number of grains can be read without
+ * going over all cells. Increase, Decrease and Cell keep it up to date. Code that writes the
+ * heights directly, such as the parallel toppling procedures, has to call AddGrains.
+ *
+ * On request the grid also keeps a histogram of the heights, see SetHistogram, so the number
+ * of cells with a given height is known without going over the grid either. Code that
+ * writes the heights directly has to update it as well (GetHistogram is NULL if not kept).
+ */
+template <typename T>
+class Grid: public GridBase {
+public:
+	//! Constructor Grid
+	Grid(int width, int height, BoundaryType boundary_type, SimulationContext & context,
+			GridLayout layout = GL_ROW_MAJOR, const GridAllocator & allocator = GridAllocator());
+
+	//! Destructor ~Grid
+	virtual ~Grid();
+
+	//! Total number of grains, counted cell by cell
+	GrainType CountGrains();
+
+	//! Running total of grains on the grid (without the reservoir), same as CountGrains
+	inline GrainType GetGrains() { return grains; }
+
+	//! Add to the running total, for heights that are changed without Increase or Decrease
+	inline void AddGrains(GrainType change) { grains += change; }
+
+	//! Return cell given coordinates
+	Cell<T> GetCell(int i, int j);
+
+	//! Return cell by index
+	Cell<T> GetCell(int n);
+
+	//! Array with the heights of all cells (plus the reservoir at the end)
+	inline T *GetHeights() { return heights; }
+
+	//! Increase the height of the cell at the given index
+	inline void Increase(long int n, const T number) {
+		T before = heights[n];
+		heights[n] += number; Altered(n, before, number);
+	}
+
+	//! Decrease the height of the cell at the given index
+	inline void Decrease(long int n, const T number) {
+		T before = heights[n];
+		heights[n] -= number; Altered(n, before, -(GrainType)number);
+	}
+
+	//! Keep a histogram of the heights from now on, or stop keeping it
+	void SetHistogram(bool keep);
+
+	//! Histogram of the heights, NULL if it is not kept
+	inline HeightHistogram<T> *GetHistogram() { return histogram; }
+
+	//! Set the same maximum capacity for all cells
+	void SetMaxCapacity(T capacity);
+
+	//! Set observer that is called as soon as the height of a cell changes (tests, debugging)
+	inline void SetAlteredFunction(AlteredCallback func) { altered_function = func; }
+
+	//! Print content of every cell
+	void Print();
+
+	//! Store or load only the heights, the directions and the capacities, not the indices
+	template<class Archive>
+	void SerializeCells(Archive & ar) {
+		ar & boost::serialization::make_array(directions, size+1);
+		ar & boost::serialization::make_array(heights, size+1);
+		ar & boost::serialization::make_array(capacities, size+1);
+		if (Archive::is_loading::value) {
+			grains = CountGrains();
+			if (histogram != NULL) SetHistogram(true);
+		}
+	}
+
+private:
+	//! Serialise using boost
+	friend class boost::serialization::access;
+
+	//! Store or load the heights and the capacities (the histogram is made again on load)
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version) {
+		GridBase::serialize(ar, version);
+		ar & boost::serialization::make_array(heights, size+1);
+		ar & boost::serialization::make_array(capacities, size+1);
+		ar & grains;
+		if (Archive::is_loading::value && (histogram != NULL)) SetHistogram(true);
+	}
+
+	//! Update the running total and the histogram and call the observer, not for the reservoir
+	inline void Altered(long int n, T before, GrainType change) {
+		if (n == size) return;
+		grains += change;
+		if (histogram != NULL) histogram->Move(before, heights[n]);
+		if (altered_function != NULL) altered_function(n);
+	}
+
+	//! Use 1-dimensional array for 2-dimensional grid, the reservoir is at index size
+	T *heights;
+
+	//! Maximum number of grains per cell
+	T *capacities;
+
+	//! Optional observer, called on every change in height of a cell (not of the reservoir)
+	AlteredCallback altered_function;
 
-	//! Random neighbour feed
-	static int neighbour_feed;
+	//! Running total of grains, see GetGrains
+	GrainType grains;
 
+	//! Number of cells per height, see SetHistogram
+	HeightHistogram<T> *histogram;
 };
 
 #endif /* GRID_H_ */
@@ -0,0 +1,139 @@
+/**
+ * @file GridAllocator.h
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef GRIDALLOCATOR_H_
+#define GRIDALLOCATOR_H_
+
+// General files
+#include <map>
+#include <vector>
+#include <iostream>
+#include <cstddef>
+
+/**
+ * The pages that back the arrays of a grid.
+ * <ul>
+ * <li>PT_NORMAL				the normal pages of the system (mostly 4 kB)
+ * <li>PT_TRANSPARENT_HUGE		ask the kernel for transparent huge pages (madvise), it does
+ * 								so if they are enabled in /sys/kernel/mm/transparent_hugepage
+ * <li>PT_EXPLICIT_HUGE			pages from the huge page pool (MAP_HUGETLB), which has to be
+ * 								reserved in /proc/sys/vm/nr_hugepages, or else transparent
+ * 								huge pages are used
+ * </ul>
+ */
+enum PageType { PT_NORMAL, PT_TRANSPARENT_HUGE, PT_EXPLICIT_HUGE };
+
+/**
+ * Make it easy to use page type in (stdout) streams.
+ */
+std::ostream& operator<<( std::ostream& os, const PageType& type );
+
+/* **************************************************************************************
+ * Interface of GridAllocator
+ * **************************************************************************************/
+
+/**
+ * Allocates the arrays of a grid directly with mmap, on normal or on huge pages. A grid of
+ * several gigabytes on normal pages takes a page fault per 4 kB at the start and misses the
+ * TLB all the time during relaxation. Arrays smaller than a huge page are always on normal
+ * pages, they would only waste memory. Use GetPageSize to see which pages were used.
+ *
+ * The kernel puts a page on the NUMA node of the thread that touches it first. If the grid
+ * is created by one thread, all pages end up on its node. With more than one band the pages
+ * of an array are touched by one thread per band instead, see FirstTouch. The bands are the
+ * bands of rows of the toppling lanes (see Toppling::SetThreads). The thread of every band
+ * but the first is pinned to a range of CPUs (see Pin), and so is the toppling worker of the
+ * same band. The first band is touched and toppled by the calling thread, which is not
+ * pinned, so its band is on the node it happens to run on. A band stays on one node only if
+ * the CPUs of a node are numbered one after the other (see numactl --hardware).
+ *
+ * A copy only has the settings, not the arrays, so an allocator can be passed by value to
+ * the grid that is going to use it.
+ */
+class GridAllocator {
+public:
+	//! Constructor GridAllocator
+	GridAllocator(PageType page_type = PT_NORMAL, int no_bands = 1);
+
+	//! Copy constructor, copies the settings only
+	GridAllocator(const GridAllocator & other);
+
+	//! Destructor ~GridAllocator, unmaps the arrays that are still there
+	~GridAllocator();
+
+	//! Allocate an array of count items, all zero
+	template <typename T>
+	inline T *Allocate(long int count) { return (T*)Map(count * sizeof(T)); }
+
+	//! Free an array from Allocate
+	inline void Free(void *array) { Unmap(array); }
+
+	//! Touch the items from bounds[b] up to bounds[b+1] with a thread per band b, and not past count
+	template <typename T>
+	inline void FirstTouch(T *array, long int count, const std::vector<long int> & bounds) {
+		Touch((char*)array, sizeof(T), count, bounds);
+	}
+
+	//! Pin the calling thread to the CPUs of the given band, false if that is not possible
+	static bool Pin(int band, int no_bands);
+
+	//! Type of pages that is asked for
+	inline PageType GetPageType() { return page_type; }
+
+	//! Number of bands that are touched by a thread of their own
+	inline int GetBands() { return no_bands; }
+
+	//! Size in bytes of the pages of the largest array, the page size of the system if none
+	inline size_t GetPageSize() { return page_size; }
+
+private:
+	//! Not assignable, the mapped arrays cannot be shared
+	GridAllocator & operator=(const GridAllocator & other);
+
+	//! Map the given number of bytes on the pages of page_type
+	void *Map(size_t bytes);
+
+	//! Unmap an array from Map
+	void Unmap(void *array);
+
+	//! Write zeros to the bands of an array with one thread per band
+	void Touch(char *array, size_t item_size, long int count,
+			const std::vector<long int> & bounds);
+
+	//! Type of pages that is asked for
+	PageType page_type;
+
+	//! Number of bands that are touched by a thread of their own
+	int no_bands;
+
+	//! Size of the pages of the largest array
+	size_t page_size;
+
+	//! Size in bytes of the largest array
+	size_t largest;
+
+	//! Length of the mapping of every array
+	std::map<void*, size_t> mappings;
+};
+
+#endif /* GRIDALLOCATOR_H_ */
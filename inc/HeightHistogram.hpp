@@ -0,0 +1,157 @@
+/**
+ * @file HeightHistogram.hpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef HEIGHTHISTOGRAM_HPP_
+#define HEIGHTHISTOGRAM_HPP_
+
+// General files
+#include <vector>
+#include <limits>
+#include <stdint.h>
+
+/* **************************************************************************************
+ * Interface of HeightHistogram
+ * **************************************************************************************/
+
+/**
+ * The number of cells per height, for heights of type T. Integer heights have a bin per
+ * height, real heights a bin per thousandth of a grain (truncated, as for PFT_GrainsPerCell).
+ * The bins are in a vector from the lowest bin seen so far, which grows when a height is
+ * outside of it. A histogram can also hold differences, counts can be negative then, see
+ * Merge.
+ *
+ * Next to the counts there is a bitmap with one bit per bin that is not zero, so going over
+ * the heights that occur (see Next) skips the empty bins 64 at a time. With real heights that
+ * take whole values most of the bins are empty.
+ */
+template <typename T>
+class HeightHistogram {
+public:
+	//! Constructor HeightHistogram without bins
+	HeightHistogram(): offset(0) { }
+
+	//! Bin of a height
+	static inline long int Bin(T height) {
+		if (std::numeric_limits<T>::is_integer) return (long int)height;
+		return (long int)(height * 1000);
+	}
+
+	//! Lowest height in the given bin
+	static inline double Value(long int bin) {
+		if (std::numeric_limits<T>::is_integer) return bin;
+		return bin / 1000.0;
+	}
+
+	//! Add number of cells to a bin
+	inline void Add(long int bin, long int number) {
+		long int b = bin - offset;
+		if ((b < 0) || (b >= (long int)counts.size())) {
+			Grow(bin);
+			b = bin - offset;
+		}
+		long int & count = counts[b];
+		bool was_empty = (count == 0);
+		count += number;
+		if (was_empty != (count == 0)) nonzero[b >> 6] ^= (uint64_t)1 << (b & 63);
+	}
+
+	//! A cell changed from height before to height after
+	inline void Move(T before, T after) {
+		long int from = Bin(before), to = Bin(after);
+		if (from == to) return;
+		Add(from, -1);
+		Add(to, 1);
+	}
+
+	//! Number of cells in a bin
+	inline long int Count(long int bin) const {
+		if ((bin < offset) || (bin >= offset + (long int)counts.size())) return 0;
+		return counts[bin - offset];
+	}
+
+	//! First bin
+	inline long int Begin() const { return offset; }
+
+	//! One past the last bin
+	inline long int End() const { return offset + counts.size(); }
+
+	//! First bin from the given one on that is not zero, End() if there is none
+	long int Next(long int bin) const {
+		long int b = (bin < offset) ? 0 : bin - offset;
+		long int size = counts.size();
+		if (b >= size) return End();
+		long int w = b >> 6;
+		uint64_t word = nonzero[w] & (~(uint64_t)0 << (b & 63));
+		while (word == 0) {
+			if (++w >= (long int)nonzero.size()) return End();
+			word = nonzero[w];
+		}
+		return offset + (w << 6) + __builtin_ctzll(word);
+	}
+
+	//! Add the counts of another histogram and set those to zero
+	void Merge(HeightHistogram & other) {
+		for (long int b = other.Next(other.Begin()); b < other.End(); b = other.Next(b + 1)) {
+			long int i = b - other.offset;
+			Add(b, other.counts[i]);
+			other.counts[i] = 0;
+			other.nonzero[i >> 6] &= ~((uint64_t)1 << (i & 63));
+		}
+	}
+
+private:
+	//! Make room for the given bin, with some room to spare, a multiple of 64 bins
+	void Grow(long int bin) {
+		if (counts.empty()) {
+			offset = bin - 32;
+			counts.resize(64, 0);
+			nonzero.resize(1, 0);
+			return;
+		}
+		long int extra = counts.size();
+		long int begin = offset, end = offset + extra;
+		if (bin < begin) begin -= ((begin - bin + extra + 63) / 64) * 64;
+		if (bin >= end) end += ((bin + 1 - end + extra + 63) / 64) * 64;
+		std::vector<long int> grown(end - begin, 0);
+		std::vector<uint64_t> bits((end - begin) / 64, 0);
+		for (unsigned int i = 0; i < counts.size(); ++i) {
+			long int j = offset - begin + i;
+			grown[j] = counts[i];
+			if (grown[j] != 0) bits[j >> 6] |= (uint64_t)1 << (j & 63);
+		}
+		counts.swap(grown);
+		nonzero.swap(bits);
+		offset = begin;
+	}
+
+	//! Lowest bin
+	long int offset;
+
+	//! Number of cells per bin, from offset on
+	std::vector<long int> counts;
+
+	//! A bit per bin that is not zero
+	std::vector<uint64_t> nonzero;
+};
+
+#endif /* HEIGHTHISTOGRAM_HPP_ */
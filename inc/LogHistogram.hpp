@@ -0,0 +1,190 @@
+/**
+ * @file LogHistogram.hpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef LOGHISTOGRAM_HPP_
+#define LOGHISTOGRAM_HPP_
+
+// General files
+#include <map>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/vector.hpp>
+
+/* **************************************************************************************
+ * Interface of LogHistogram
+ * **************************************************************************************/
+
+/**
+ * Count events of a given "type", like EventCounter, but in a flat array of buckets rather
+ * than in a map, so adding an event does not need a tree lookup or an allocation. The types
+ * are counted in units, a multiple of the unit is an integer. For example, the number of
+ * grains per cell is counted with a unit of 1/(L*L), so every total of grains has its own
+ * bucket.
+ *
+ * The layout is that of an HDR histogram. The magnitudes below 2^precision units all have a
+ * bucket of their own. Above that, every power of two from 2^k till 2^(k+1) is divided in
+ * 2^(precision-1) buckets of equal width, so the relative error is less than
+ * 2^-(precision-1). Negative types have the same buckets, mirrored. The buckets of a power of
+ * two are only allocated the first time it is used, so the memory is bounded, but only the
+ * range in use takes it. Histograms with the same unit and precision can be merged.
+ *
+ * The map of getEvents has one item per bucket that is not empty, at the middle of the
+ * bucket, for PlotFigure. A wider bucket holds more events for the same density, so for a
+ * plot of the distribution itself ask for the events per unit, the count divided by the
+ * width of the bucket. Cumulative plots need the counts as they are.
+ */
+template <typename T>
+class LogHistogram {
+public:
+	//! Construct a histogram with the given unit and number of bits of precision
+	LogHistogram(double unit = 1, int precision = 7): unit(unit), scale(1.0 / unit),
+			precision(precision) {
+		assert ((precision > 0) && (precision < 31));
+		for (int s = 0; s < 2; ++s) octaves[s].resize(64);
+	}
+
+	//! Add one event of given type
+	inline void AddEvent(const T type) { Add(Units(type), 1); }
+
+	//! Add "freq" events of a given type
+	inline void AddEvent(const T type, long int freq) { Add(Units(type), freq); }
+
+	//! Add all events of another histogram (e.g. of another trial)
+	void Merge(LogHistogram & other) {
+		assert ((unit == other.unit) && (precision == other.precision));
+		for (int s = 0; s < 2; ++s) {
+			Add(linear[s], other.linear[s]);
+			for (int k = 0; k < 64; ++k) Add(octaves[s][k], other.octaves[s][k]);
+		}
+	}
+
+	//! Total number of events
+	long int GetTotal() const {
+		long int total = 0;
+		for (int s = 0; s < 2; ++s) {
+			total += Sum(linear[s]);
+			for (int k = 0; k < 64; ++k) total += Sum(octaves[s][k]);
+		}
+		return total;
+	}
+
+	//! Get events, one per bucket that is not empty, per unit of the bucket if asked for
+	std::map<T, double> & getEvents(bool per_unit = false) {
+		events.clear();
+		for (int s = 0; s < 2; ++s) {
+			ToEvents(linear[s], s, 0, 1, per_unit);
+			for (int k = precision; k < 64; ++k) {
+				long long width = (long long)1 << (k - precision + 1);
+				ToEvents(octaves[s][k], s, (long long)1 << k, width, per_unit);
+			}
+		}
+		return events;
+	}
+
+private:
+	//! Type in units, rounded to the nearest unit
+	inline long long Units(T type) const {
+		if (std::numeric_limits<T>::is_integer && (unit == 1)) return type;
+		return (long long)std::floor(type * scale + 0.5);
+	}
+
+	//! Add number of events to the bucket of the given number of units
+	inline void Add(long long units, long int number) {
+		int s = (units < 0) ? 1 : 0;
+		unsigned long long magnitude = (units < 0) ? -units : units;
+		if (magnitude < ((unsigned long long)1 << precision)) {
+			if (linear[s].empty()) linear[s].resize((size_t)1 << precision, 0);
+			linear[s][magnitude] += number;
+			return;
+		}
+		int k = 63 - __builtin_clzll(magnitude);
+		std::vector<long int> & octave = octaves[s][k];
+		if (octave.empty()) octave.resize((size_t)1 << (precision - 1), 0);
+		octave[(magnitude >> (k - precision + 1)) - ((unsigned long long)1 << (precision - 1))]
+				+= number;
+	}
+
+	//! Add the buckets of another histogram
+	static void Add(std::vector<long int> & buckets, const std::vector<long int> & other) {
+		if (other.empty()) return;
+		if (buckets.empty()) buckets.resize(other.size(), 0);
+		for (unsigned int b = 0; b < other.size(); ++b) buckets[b] += other[b];
+	}
+
+	//! Number of events in the given buckets
+	static long int Sum(const std::vector<long int> & buckets) {
+		long int sum = 0;
+		for (unsigned int b = 0; b < buckets.size(); ++b) sum += buckets[b];
+		return sum;
+	}
+
+	//! Serialise using boost, the map of events is made again by getEvents
+	friend class boost::serialization::access;
+
+	//! The serialise function has access to all fields
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version) {
+		ar & unit;
+		ar & scale;
+		ar & precision;
+		for (int s = 0; s < 2; ++s) {
+			ar & linear[s];
+			ar & octaves[s];
+		}
+	}
+
+	//! Put the buckets that start at the given magnitude in the map of events
+	void ToEvents(const std::vector<long int> & buckets, int s, long long begin,
+			long long width, bool per_unit) {
+		for (unsigned int b = 0; b < buckets.size(); ++b) {
+			if (buckets[b] == 0) continue;
+			double middle = begin + b * width + (width - 1) / 2.0;
+			T type = (T)((s ? -middle : middle) * unit);
+			events[type] += per_unit ? buckets[b] / (double)width : (double)buckets[b];
+		}
+	}
+
+	//! Size of a unit
+	double unit;
+
+	//! Units per one, 1/unit
+	double scale;
+
+	//! Number of bits of the magnitudes with a bucket of their own
+	int precision;
+
+	//! Buckets of the magnitudes below 2^precision, for positive (0) and negative (1) types
+	std::vector<long int> linear[2];
+
+	//! Buckets of the magnitudes from 2^k till 2^(k+1), per sign and power k
+	std::vector< std::vector<long int> > octaves[2];
+
+	//! Map with the events for getEvents
+	std::map<T, double> events;
+};
+
+#endif /* LOGHISTOGRAM_HPP_ */
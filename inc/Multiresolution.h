@@ -86,7 +86,7 @@ public:
 	~Multiresolution();
 
 	//! Set grid to operate on
-	inline void SetGrid(Grid * grid) { this->grid = grid; }
+	inline void SetGrid(Grid<GrainType> * grid) { this->grid = grid; }
 
 	//! Return result of calculations in the form of a matrix, CoarseCell
 	CoarseCell* Tick();
@@ -112,7 +112,7 @@ protected:
 
 private:
 	//! Reference to grid
-	Grid * grid;
+	Grid<GrainType> * grid;
 
 	//! Minimum level over which
 	int min_level;
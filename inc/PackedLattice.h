@@ -0,0 +1,186 @@
+/**
+ * @file PackedLattice.h
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef PACKEDLATTICE_H_
+#define PACKEDLATTICE_H_
+
+// General files
+#include <vector>
+#include <Typedefs.h>
+
+#include <boost/unordered_map.hpp>
+
+/* **************************************************************************************
+ * Interface of PackedLattice
+ * **************************************************************************************/
+
+/**
+ * A compact lattice for the BTW model with dissipating boundaries. In the stationary state
+ * almost every cell holds 0 to 3 grains, so the stable heights are stored in 2 bits per cell:
+ * per row, words of 64 cells, the low bits of the heights in one word and the high bits in
+ * the next. A grid of 65536*65536 cells takes 1 GB this way, against 4 GB with Grid<uint8_t>
+ * (plus its directions and capacities).
+ *
+ * The few cells with 4 grains or more are kept aside in a sparse overflow table, and are
+ * toppled one by one as in ToppleAbelian. If an avalanche has more unstable cells than the
+ * dense threshold, it is relaxed with bitsliced sweeps instead: all cells of a row topple at
+ * the same time, 64 of them with a handful of word operations. For that the rows with
+ * unstable cells get a third bit plane, a height of 0 to 7 then fits in the three bits.
+ * Because of the Abelian property the order of toppling does not matter: the avalanche
+ * sizes and the heights are the same as with the other toppling procedures.
+ *
+ * There is no reservoir, the grains that leave the grid are only counted.
+ */
+class PackedLattice {
+public:
+	//! Constructor PackedLattice
+	PackedLattice(int width, int height);
+
+	//! Destructor ~PackedLattice
+	virtual ~PackedLattice();
+
+	//! Width
+	inline int GetWidth() { return width; }
+
+	//! Height
+	inline int GetHeight() { return height; }
+
+	//! Number of cells
+	inline long int GetSize() { return size; }
+
+	//! Number of grains on the cell with given index
+	int GetValue(long int n);
+
+	//! Add grains to the cell with given index, it goes to the overflow if unstable
+	void Increase(long int n, int number = 1);
+
+	//! Topple all unstable cells, avalanche_size is the number of topplings
+	void Relax(long int & avalanche_size);
+
+	//! Number of unstable cells above which an avalanche is relaxed with dense sweeps, by
+	//! default the number of words in a row
+	inline void SetDenseThreshold(long int cells) { dense_threshold = cells; }
+
+	//! Number of cells in the overflow table, these are unstable
+	inline long int GetUnstable() { return overflow.size(); }
+
+	//! Total number of grains on the grid
+	GrainType CountGrains();
+
+	//! Count the cells per stable height, counts should have room for 4 values
+	void CountHeights(long int *counts);
+
+	//! Grains that left the grid over the boundary so far
+	inline GrainType GetBoundaryOutflow() { return outflow; }
+
+	//! Bytes used by the heights
+	inline long int GetMemory() { return planes.size() * sizeof(uint64_t); }
+
+	//! Remove all grains
+	void Clear();
+
+	//! Print content of every cell
+	void Print();
+
+private:
+	//! Stable height of a cell from the bit planes
+	inline int GetBits(long int n) {
+		long int w = WordIndex(n); int b = n % width & 63;
+		return ((planes[w] >> b) & 1) | (((planes[w+1] >> b) & 1) << 1);
+	}
+
+	//! Store a stable height of a cell in the bit planes
+	inline void SetBits(long int n, int value) {
+		long int w = WordIndex(n); int b = n % width & 63;
+		uint64_t bit = (uint64_t)1 << b;
+		planes[w] = (value & 1) ? (planes[w] | bit) : (planes[w] & ~bit);
+		planes[w+1] = (value & 2) ? (planes[w+1] | bit) : (planes[w+1] & ~bit);
+	}
+
+	//! Index of the word with the low bits of a cell, the high bits are in the next one
+	inline long int WordIndex(long int n) {
+		return ((n / width) * words + (n % width >> 6)) * 2;
+	}
+
+	//! Add grains to a cell, and push it on the stack if it reaches the limit
+	void Add(long int n, long int number, int limit);
+
+	//! Topple a cell until it is below the limit
+	void ToppleCell(long int n, int limit, long int & avalanche_size);
+
+	//! Relax the unstable cells with bitsliced sweeps
+	void ToppleDense(long int & avalanche_size);
+
+	//! Topple all cells with a height of 4 or more once, returns the number of topplings
+	long int Sweep();
+
+	//! An empty third bit plane
+	uint64_t *NewPlane();
+
+	//! Width of the grid
+	int width;
+
+	//! Height of the grid
+	int height;
+
+	//! Number of cells, width*height
+	long int size;
+
+	//! Words per row per bit plane
+	int words;
+
+	//! The cells of the last word of a row that are on the grid
+	uint64_t last_mask;
+
+	//! Low and high bit planes of the stable heights, per row, interleaved per word
+	std::vector<uint64_t> planes;
+
+	//! Heights of the unstable cells (4 or more), outside of the dense sweeps
+	boost::unordered_map<long int, long int> overflow;
+
+	//! Cells that reached the limit and still have to topple
+	std::vector<long int> stack;
+
+	//! Third bit plane of the rows with unstable cells during the dense sweeps, else NULL
+	std::vector<uint64_t*> upper;
+
+	//! Third bit planes that are not in use
+	std::vector<uint64_t*> spare;
+
+	//! First and last row with a third bit plane
+	int top, bottom;
+
+	//! First and last word with a third bit set
+	int left, right;
+
+	//! Scratch rows with the topplings of the row above and of the current row
+	std::vector<uint64_t> above, current, zeros;
+
+	//! Unstable cells above which dense sweeps are used
+	long int dense_threshold;
+
+	//! Grains that left the grid
+	GrainType outflow;
+};
+
+#endif /* PACKEDLATTICE_H_ */
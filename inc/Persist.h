@@ -36,6 +36,9 @@
 
 typedef boost::function<void(Config&)> AlterConfigFunc;
 
+//! Add the figures of the duration, radius and extent of avalanches, they are not default
+void AddShapeFigures(Config & config);
+
 /**
  * Basically this class is meant to add some persistence to configuration values. There
  * are several things that come into mind:
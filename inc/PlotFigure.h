@@ -44,7 +44,7 @@ typedef double DataDecoratorType;
  */
 struct DataForPlot {
 	DataForPlot(): data2file(true), file2data(true) { };
-	std::map<DataDecoratorType, int> *events;
+	std::map<DataDecoratorType, double> *events;
 	float *values;
 	int len;
 	//! Time id is used to be able to plot a series of pictures with "quasi" time stamps
@@ -34,9 +34,15 @@
  * - PFT_Height						# grains per cell in 2D grid
  * - PFT_Dissipation				# dissipation units per cell in 2D grid (different grid)
  * - PFT_CriticalCells				# of critical cells before/after (check the code) an avalanche
+ * - PFT_GrainsPerCell				distribution of # grains per cell
+ * - PFT_AvalancheArea				distribution of # different cells that toppled in an avalanche
+ * - PFT_AvalancheDuration			distribution of # waves of an avalanche
+ * - PFT_AvalancheRadius			distribution of the radius of gyration of an avalanche
+ * - PFT_AvalancheExtent			distribution of the largest side of its bounding box
  */
 enum PlotFigureType { PFT_Avalanche, PFT_GrainsDuringAvalanche, PFT_GrainsBeforeAvalanche,
-	PFT_GrainsDiffAvalanche, PFT_Height, PFT_Dissipation, PFT_CriticalCells, PFT_GrainsPerCell };
+	PFT_GrainsDiffAvalanche, PFT_Height, PFT_Dissipation, PFT_CriticalCells, PFT_GrainsPerCell,
+	PFT_AvalancheArea, PFT_AvalancheDuration, PFT_AvalancheRadius, PFT_AvalancheExtent };
 
 
 #endif /* PLOTFIGURETYPE_H_ */
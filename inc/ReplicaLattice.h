@@ -0,0 +1,190 @@
+/**
+ * @file ReplicaLattice.h
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef REPLICALATTICE_H_
+#define REPLICALATTICE_H_
+
+// General files
+#include <vector>
+#include <assert.h>
+
+#include <Grid.h>
+#include <Toppling.h>
+#include <LogHistogram.hpp>
+#include <SimulationContext.h>
+
+/* **************************************************************************************
+ * Interface of ReplicaLattice
+ * **************************************************************************************/
+
+/**
+ * Sixty-four independent BTW sandpiles on the same L*L lattice, multi-spin coded: every cell
+ * has three words for the three bits of its height, and bit b of each word belongs to
+ * replica b. A height of 0 to 7 fits, which is enough: a stable cell gets at most one grain
+ * from the drive, and in a synchronous sweep a cell that topples keeps at most 3 grains and
+ * gets at most 4. All replicas topple together in sweeps: the replicas in which a cell
+ * topples form a mask, and the mask is added to the heights of the neighbours with bitwise
+ * adders, for all 64 replicas at once.
+ *
+ * A sweep only goes over the cells that are unstable in at least one replica. The avalanches
+ * of the replicas are at different places, with thin fronts, so sweeps over whole rows of
+ * the lattice spend most of their time on cells where nothing happens.
+ *
+ * Every replica has its own SimulationContext, with the feeds of the configuration and the
+ * given first stream plus the replica as stream, and drops its grains where SandPile::Drive
+ * would. Replica b thus sees the same grains as trial first_stream + b in
+ * Experiment::RunParallel, and because of the Abelian property it has the same avalanches.
+ *
+ * Only BTW with dissipating boundaries, or with walls (BT_WALL_DISSIPATING, the default of
+ * BTW) is supported. A grain that would go over a wall goes back to the cell it came from,
+ * which is the same as toppling with one grain less at the wall, see ToppleAbelian.
+ *
+ * Per replica the sizes and areas of the avalanches are counted in the same counters as the
+ * ones of Experiment, so they can be merged and plotted.
+ *
+ * Experiment does not run its trials on replicas. The avalanches of the replicas seldom
+ * overlap, so a toppled word mostly holds a single replica, and 64 sandpiles that topple
+ * with Toppling::ToppleAbelian one after the other are about twice as fast.
+ */
+class ReplicaLattice {
+public:
+	//! Number of replicas, one per bit of a word
+	static const int Replicas = 64;
+
+	//! Constructor ReplicaLattice, the replicas have streams first_stream to first_stream+63
+	ReplicaLattice(int L, BoundaryType boundary_type, const std::vector<int> & feeds,
+			int first_stream = 0);
+
+	//! Destructor ~ReplicaLattice
+	virtual ~ReplicaLattice();
+
+	//! True if the replicas can be used for given toppling method and boundary type
+	static bool Supports(TopplingMethod toppling_method, BoundaryType boundary_type);
+
+	//! Every replica drops a grain on a random spot of its own
+	void Drive();
+
+	//! Add a grain to the cell with given index in the given replica, at most one per relaxation
+	void Increase(int replica, long int n);
+
+	//! Relax all replicas, and count the sizes and areas of the avalanches if measured
+	void Relax(bool measure = true);
+
+	//! Number of topplings in the last avalanche of a replica
+	inline long int GetAvalancheSize(int replica) { return sizes[replica]; }
+
+	//! Number of cells that toppled in the last avalanche of a replica
+	inline long int GetAvalancheArea(int replica) { return areas[replica]; }
+
+	//! Index of the cell that got the last grain in a replica
+	inline long int GetDriveSite(int replica) { return drive_sites[replica]; }
+
+	//! The measured avalanche sizes of a replica
+	inline LogHistogram<double> & GetAvalanches(int replica) { return avalanches[replica]; }
+
+	//! The measured avalanche areas of a replica
+	inline LogHistogram<double> & GetAreas(int replica) { return area_counters[replica]; }
+
+	//! Number of grains on a cell of a replica
+	int GetValue(int replica, long int n);
+
+	//! Total number of grains on the lattice of a replica
+	GrainType CountGrains(int replica);
+
+	//! Type of boundary
+	inline BoundaryType GetBoundaryType() { return boundary_type; }
+
+	//! Remove all grains, the random sequences go on
+	void Clear();
+
+private:
+	//! Add a mask to a bitsliced counter, a bit per replica
+	static inline void Count(uint64_t *counter, uint64_t mask) {
+		for (int k = 0; mask; ++k) {
+			uint64_t carry = counter[k] & mask;
+			counter[k] ^= mask;
+			mask = carry;
+		}
+	}
+
+	//! Value of a bitsliced counter for a replica
+	static long int Value(const uint64_t *counter, int replica);
+
+	//! Add a grain to a cell in the replicas of the mask, and keep track of unstable cells
+	inline void Add(long int n, uint64_t mask) {
+		uint64_t carry = bits[0][n] & mask;
+		bits[0][n] ^= mask;
+		mask = carry;
+		carry = bits[1][n] & mask;
+		bits[1][n] ^= mask;
+		if (!carry) return;
+		assert (!(bits[2][n] & carry));
+		if (!bits[2][n]) unstable.push_back(n);
+		bits[2][n] |= carry;
+	}
+
+	//! Topple the cells of all replicas with 4 grains or more once, false if none did
+	bool Sweep();
+
+	//! Size of the lattice, L*L cells
+	int L;
+
+	//! Number of cells
+	long int size;
+
+	//! Dissipating, or walls and dissipating
+	BoundaryType boundary_type;
+
+	//! The bits of the heights, one word per cell and one bit per replica
+	std::vector<uint64_t> bits[3];
+
+	//! Cells with 4 grains or more in at least one replica
+	std::vector<long int> unstable;
+
+	//! Cells that topple in the current sweep, and the replicas in which they topple
+	std::vector<long int> toppled;
+	std::vector<uint64_t> masks;
+
+	//! Replicas in which a cell toppled in the current avalanche
+	std::vector<uint64_t> visited;
+
+	//! Cells that toppled in the current avalanche, see visited
+	std::vector<long int> touched;
+
+	//! Bitsliced counters of the topplings and of the new cells in the current avalanche
+	uint64_t size_counter[64], area_counter[64];
+
+	//! Size and area of the last avalanche per replica
+	long int sizes[Replicas], areas[Replicas];
+
+	//! Random generators per replica
+	std::vector<SimulationContext*> contexts;
+
+	//! Cell that got the last grain per replica
+	long int drive_sites[Replicas];
+
+	//! Avalanche sizes and areas per replica
+	std::vector<LogHistogram<double> > avalanches, area_counters;
+};
+
+#endif /* REPLICALATTICE_H_ */
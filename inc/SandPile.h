@@ -28,10 +28,15 @@
 // General files
 #include <Grid.h>
 #include <Toppling.h>
-#include <EventCounter.hpp>
+#include <LogHistogram.hpp>
 
 #include <boost/random/mersenne_twister.hpp>
 
+namespace boost { namespace archive {
+	class binary_oarchive;
+	class binary_iarchive;
+} }
+
 /* **************************************************************************************
  * Interface of SandPile
  * **************************************************************************************/
@@ -45,22 +50,140 @@
  * GVT_DIRECTION:			"direction" of a cell in dissipation grid
  * GVT_NCN:					non-critical neighbourhood (none of the neighbours are critical)
  * GVT_ORDERPARAM1:			order parameter 1, row sums, then sum_ij { r_i r_j |i-j| } plus same for column sums
+ * GVT_BOUNDARY_OUTFLOW:	grains that left over the boundary so far (GetValue only)
+ * GVT_BULK_DISSIPATION:	grains that disappeared within the grid so far (GetValue only)
  * ...
  * GVT_NOF_TYPES:			total GridValueType
  */
 enum GridValueType { GVT_HEIGHT, GVT_HEIGHT_SCALED, GVT_CRITICAL_CELLS, GVT_DISSIPATION,
-	GVT_DIRECTION, GVT_NCN, GVT_ORDERPARAM1, GVT_NOF_TYPES };
+	GVT_DIRECTION, GVT_NCN, GVT_ORDERPARAM1, GVT_BOUNDARY_OUTFLOW, GVT_BULK_DISSIPATION,
+	GVT_NOF_TYPES };
 
 /**
  * The sandpile has access to a sand_grid with a specific topology. Most commonly a rectangular
  * sand_grid. In each sand_grid cell there are a number of grains, called the "height". There are
  * toppling rules defined that takes as input the height of a cell and adjust subsequently
  * the height of that cell and of its neighbours.
+ *
+ * SandPileBase is the interface that does not depend on the type of the heights. Create
+ * a sandpile with Create, which picks the instantiation of SandPile<T> at runtime.
+ *
+ * All random generators of a sandpile are in its SimulationContext, which should outlive the
+ * sandpile. Sandpiles with their own context can run at the same time.
+ */
+class SandPileBase {
+public:
+	//! Constructor SandPileBase
+	SandPileBase(SimulationContext & context, int L, TopplingMethod toppling_method,
+			BoundaryType type = BT_UNDEFINED, GridLayout layout = GL_ROW_MAJOR,
+			const GridAllocator & allocator = GridAllocator());
+
+	//! Destructor ~SandPileBase
+	virtual ~SandPileBase();
+
+	//! Create a sandpile with heights of the given type
+	static SandPileBase *Create(SimulationContext & context, HeightType height_type, int L,
+			TopplingMethod toppling_method, BoundaryType type = BT_UNDEFINED,
+			GridLayout layout = GL_ROW_MAJOR, const GridAllocator & allocator = GridAllocator());
+
+	//! Populate with a certain number of particles
+	virtual void Populate(int no_cells, GrainType no_particles) = 0;
+
+	//! Loading mechanism, pick random spot and add a grain
+	virtual void Drive() = 0;
+
+	//! Index of the cell that got the last grain, row by row whatever the layout of the grid
+	inline long int GetDriveSite() { return drive_site; }
+
+	//! Relax, measure/store the avalanche size and return it
+	virtual int Relax(bool measure=true) = 0;
+
+	//! Relax, and also get the area, duration and extent of the avalanche
+	virtual int Relax(AvalancheShape & shape, bool measure=true) = 0;
+
+	//! Clear
+	virtual void Clear() = 0;
+
+	//! Print
+	virtual void Print() = 0;
+
+	//! Coarsen e.g. height field into patches of size patch_L * patch_L
+	virtual void Coarsen(float *values, int array_size, int patch_L) = 0;
+
+	//! The number plus size of avalanches
+	std::map<int, double> & GetAvalanches() { return avalanches.getEvents(); }
+
+	//! Get values for display
+	virtual void GetValues(float *values, const GridValueType gvt) = 0;
+
+	//! Get certain general/average values
+	virtual void GetValue(long int &value, const GridValueType gvt) = 0;
+
+	//! Keep a histogram of the heights in the grid from now on, or stop keeping it
+	virtual void SetHeightHistogram(bool keep) = 0;
+
+	//! Add the number of cells per height to the counter, see Grid::SetHistogram
+	virtual void CountHeights(LogHistogram<double> & counter) = 0;
+
+	//! Number of grains during avalanches...
+	inline LogHistogram<int> *GetGrainsDuringAvalanches() { return GetToppling()->GetNoDuringAvalanches(); }
+
+	//! Get toppling
+	virtual TopplingBase *GetToppling() = 0;
+
+	//! Get toppling on dissipation grid
+	virtual TopplingBase *GetDissToppling() = 0;
+
+	//! Size in bytes of the pages of the sand grid, see Grid::GetPageSize
+	virtual size_t GetPageSize() = 0;
+
+	//! Store the grids, the state of the toppling procedures and the avalanches in a checkpoint
+	virtual void StoreState(boost::archive::binary_oarchive & ar) = 0;
+
+	//! Continue from a checkpoint of a sandpile with the same configuration
+	virtual void LoadState(boost::archive::binary_iarchive & ar) = 0;
+
+	//! Store only the cells of the grids (heights, directions and capacities) in the cache
+	virtual void StoreCells(boost::archive::binary_oarchive & ar) = 0;
+
+	//! Start from the cells of a sandpile with the same configuration
+	virtual void LoadCells(boost::archive::binary_iarchive & ar) = 0;
+
+protected:
+	//! System size
+	int L;
+
+	//! Boundary type used for sand_grid
+	BoundaryType boundary_type;
+
+	//! Order of the cells in the grids
+	GridLayout layout;
+
+	//! Settings for the allocation of the grids (every grid gets a copy)
+	GridAllocator allocator;
+
+	//! PFT_Avalanche counter
+	LogHistogram<int> avalanches;
+
+	//! Index of the cell that got the last grain, see Drive
+	long int drive_site;
+
+	//! Simulation context with the generators for driving (FT_DRIVE) and for the
+	//! dissipation grid (FT_DISSIPATION), not owned by the sandpile
+	SimulationContext *context;
+};
+
+/**
+ * The sandpile with heights of type T. There are explicit instantiations for uint8_t,
+ * int32_t, float and double.
  */
-class SandPile {
+template <typename T>
+class SandPile: public SandPileBase {
 public:
 	//! Constructor SandPile
-	SandPile(int L, TopplingMethod toppling_method, BoundaryType type = BT_UNDEFINED);
+	SandPile(SimulationContext & context, int L, TopplingMethod toppling_method,
+			BoundaryType type = BT_UNDEFINED, GridLayout layout = GL_ROW_MAJOR,
+			const GridAllocator & allocator = GridAllocator());
 
 	//! Destructor ~SandPile
 	virtual ~SandPile();
@@ -68,18 +191,15 @@ public:
 	//! Populate with a certain number of particles
 	void Populate(int no_cells, GrainType no_particles);
 
-	//! Set feed for driving
-	inline static void SetDriveFeed(int feed) { drive_feed = feed; }
-
-	//! Set feed for dissipation
-	inline static void SetDissipationFeed(int feed) { diss_feed = feed; }
-
 	//! Loading mechanism, pick random spot and add a grain
 	void Drive();
 
 	//! Relax, measure/store the avalanche size and return it
 	int Relax(bool measure=true);
 
+	//! Relax, and also get the area, duration and extent of the avalanche
+	int Relax(AvalancheShape & shape, bool measure=true);
+
 	//! Clear
 	void Clear();
 
@@ -89,54 +209,54 @@ public:
 	//! Coarsen e.g. height field into patches of size patch_L * patch_L
 	void Coarsen(float *values, int array_size, int patch_L);
 
-	//! The number plus size of avalanches
-	std::map<int, int> & GetAvalanches() { return avalanches.getEvents(); }
-
 	//! Get values for display
 	void GetValues(float *values, const GridValueType gvt);
 
 	//! Get certain general/average values
 	void GetValue(long int &value, const GridValueType gvt);
 
-	//! Number of grains during avalanches...
-	inline EventCounter<int> *GetGrainsDuringAvalanches() { return toppling->GetNoDuringAvalanches(); }
+	//! Keep a histogram of the heights in the grid from now on, or stop keeping it
+	inline void SetHeightHistogram(bool keep) { grid->SetHistogram(keep); }
+
+	//! Add the number of cells per height to the counter, see Grid::SetHistogram
+	void CountHeights(LogHistogram<double> & counter);
 
 	//! Get toppling
-	inline Toppling *GetToppling() { return toppling; };
+	inline Toppling<T> *GetToppling() { return toppling; };
 
 	//! Get toppling on dissipation grid
-	inline Toppling *GetDissToppling() { return diss_toppling; };
+	inline Toppling<T> *GetDissToppling() { return diss_toppling; };
+
+	//! Size in bytes of the pages of the sand grid, see Grid::GetPageSize
+	inline size_t GetPageSize() { return grid->GetPageSize(); }
+
+	//! Store the grids, the state of the toppling procedures and the avalanches in a checkpoint
+	void StoreState(boost::archive::binary_oarchive & ar);
+
+	//! Continue from a checkpoint of a sandpile with the same configuration
+	void LoadState(boost::archive::binary_iarchive & ar);
+
+	//! Store only the cells of the grids (heights, directions and capacities) in the cache
+	void StoreCells(boost::archive::binary_oarchive & ar);
+
+	//! Start from the cells of a sandpile with the same configuration
+	void LoadCells(boost::archive::binary_iarchive & ar);
 protected:
 	//! Create and use a dissipation grid
 	void DissipationGrid(TopplingMethod method, int width, int height);
 
 private:
-	//! System size
-	int L;
-
 	//! The sand_grid upon which the sandpile is defined
-	Grid * grid;
+	Grid<T> * grid;
 
 	//! An additional grid that stores e.g. an "energy-like" field separate from the grains
-	Grid * diss_grid;
+	Grid<T> * diss_grid;
 
 	//! The toppling procedure for grains
-	Toppling *toppling;
+	Toppling<T> *toppling;
 
 	//! The toppling procedure for energy/dissipation
-	Toppling *diss_toppling;
-
-	//! Boundary type used for sand_grid
-	BoundaryType boundary_type;
-
-	//! PFT_Avalanche counter
-	EventCounter<int> avalanches;
-
-	//! Dissipation grid feed
-	static int diss_feed;
-
-	//! Driving feed for dropping random grains on grid
-	static int drive_feed;
+	Toppling<T> *diss_toppling;
 };
 
 #endif /* SANDPILE_H_ */
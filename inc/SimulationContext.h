@@ -0,0 +1,176 @@
+/**
+ * @file SimulationContext.h
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef SIMULATIONCONTEXT_H_
+#define SIMULATIONCONTEXT_H_
+
+// General files
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <sstream>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_smallint.hpp>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/string.hpp>
+
+#include <CounterRandom.h>
+
+/* **************************************************************************************
+ * Interface of SimulationContext
+ * **************************************************************************************/
+
+/**
+ * The random generators in a simulation, in the same order as the feeds in the
+ * configuration file:
+ * <ul>
+ * <li>FT_GRID			order in which the toppling iterators go over the cells
+ * <li>FT_TOPPLING		neighbours and dissipation on toppling
+ * <li>FT_DIRECTION		direction of new cells
+ * <li>FT_DRIVE			where grains are dropped
+ * <li>FT_DISSIPATION	where the dissipation grid is populated
+ * <li>FT_NEIGHBOUR		random neighbours
+ * </ul>
+ */
+enum FeedType { FT_GRID, FT_TOPPLING, FT_DIRECTION, FT_DRIVE, FT_DISSIPATION, FT_NEIGHBOUR,
+	NO_FEED_TYPES };
+
+/**
+ * All random state of one simulation: a feed and a generator for each FeedType. A context is
+ * passed to the Grid, the Toppling and the SandPile of a simulation, and it should outlive
+ * them. Simulations with their own context do not share anything random, so they can run in
+ * the same process and at the same time, and give the same results as when they run alone.
+ *
+ * A context can be one of several streams, e.g. one per trial. Stream 0 uses the feeds as
+ * they are, other streams mix the stream number into the feeds.
+ *
+ * Next to the generators there is a counter-based generator per type, with the feed and the
+ * stream as key. The stochastic toppling methods and the drive use these.
+ */
+class SimulationContext {
+public:
+	//! Constructor SimulationContext with the default feeds
+	SimulationContext(int stream = 0);
+
+	//! Constructor SimulationContext with the feeds of a configuration file
+	SimulationContext(const std::vector<int> & feeds, int stream = 0);
+
+	//! Destructor ~SimulationContext
+	virtual ~SimulationContext();
+
+	//! Set feed of the given type, its generator starts again
+	void SetFeed(FeedType type, int feed);
+
+	//! Get feed of the given type
+	inline int GetFeed(FeedType type) { return feeds[type]; }
+
+	//! Get the generator of the given type
+	inline boost::mt19937 & GetGenerator(FeedType type) { return generators[type]; }
+
+	//! Get the counter-based generator of the given type
+	inline CounterRandom & GetCounterRandom(FeedType type) { return counter_randoms[type]; }
+
+	//! The stream of this context
+	inline int GetStream() { return stream; }
+
+	//! The seed for a generator with the given feed in the stream of this context
+	uint32_t Seed(int feed);
+
+private:
+	//! Serialise using boost, see save and load
+	friend class boost::serialization::access;
+
+	//! Store the feeds, the state of each generator and the position in each sequence
+	template<class Archive>
+	void save(Archive & ar, const unsigned int version) const {
+		ar & stream;
+		for (int f = 0; f < NO_FEED_TYPES; ++f) {
+			std::ostringstream state;
+			state << generators[f];
+			std::string s = state.str();
+			uint64_t position = counter_randoms[f].GetPosition();
+			ar & feeds[f];
+			ar & s;
+			ar & position;
+		}
+	}
+
+	//! Continue every generator and sequence where it was stored
+	template<class Archive>
+	void load(Archive & ar, const unsigned int version) {
+		ar & stream;
+		for (int f = 0; f < NO_FEED_TYPES; ++f) {
+			int feed;
+			std::string s;
+			uint64_t position;
+			ar & feed;
+			ar & s;
+			ar & position;
+			SetFeed((FeedType)f, feed);
+			std::istringstream state(s);
+			state >> generators[f];
+			counter_randoms[f].SetPosition(position);
+		}
+	}
+
+	BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+	//! Use the default feeds
+	void SetDefaultFeeds();
+
+	//! The stream, e.g. the trial
+	int stream;
+
+	//! Feed per type
+	int feeds[NO_FEED_TYPES];
+
+	//! Generator per type
+	boost::mt19937 generators[NO_FEED_TYPES];
+
+	//! Counter-based generator per type
+	CounterRandom counter_randoms[NO_FEED_TYPES];
+};
+
+/**
+ * A random index below a given size, drawn from a generator of a context. This can be used
+ * with std::random_shuffle.
+ */
+class RandomIndex {
+public:
+	//! Constructor RandomIndex
+	RandomIndex(boost::mt19937 & generator): generator(generator) { }
+
+	//! Random number from 0 till size-1
+	inline std::ptrdiff_t operator()(std::ptrdiff_t size) {
+		boost::uniform_smallint<size_t> distr(0, size-1);
+		return distr(generator);
+	}
+private:
+	//! The generator to draw from
+	boost::mt19937 & generator;
+};
+
+#endif /* SIMULATIONCONTEXT_H_ */
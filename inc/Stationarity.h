@@ -0,0 +1,116 @@
+/**
+ * @file Stationarity.h
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#ifndef STATIONARITY_H_
+#define STATIONARITY_H_
+
+// General files
+#include <deque>
+
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/deque.hpp>
+
+/* **************************************************************************************
+ * Interface of Stationarity
+ * **************************************************************************************/
+
+/**
+ * Decides online when a series, e.g. the number of grains per cell after every tick, has
+ * become stationary. The values are averaged in batches. The last batch means form a window,
+ * and the mean of its first half is compared with the mean of its second half: if they
+ * differ less than z standard errors (from the variances within the halves), there is no
+ * trend anymore and the series is taken to be stationary from then on. Batches should be
+ * long enough to make their means roughly independent.
+ */
+class Stationarity {
+public:
+	//! Constructor Stationarity, with the number of values per batch and batches per window
+	Stationarity(long int batch_size, int window = 10, double z = 2.0);
+
+	//! Destructor ~Stationarity
+	virtual ~Stationarity();
+
+	//! Add the next value, returns true if the series is stationary (from now on)
+	inline bool Add(double value) {
+		if (stationary) return true;
+		++values;
+		sum += value;
+		if (++count == batch_size) Batch();
+		return stationary;
+	}
+
+	//! True if the series is found to be stationary
+	inline bool IsStationary() { return stationary; }
+
+	//! Take the series to be stationary from the start, e.g. if it starts in a stationary state
+	inline void SetStationary() { stationary = true; }
+
+	//! Number of values till the series was found to be stationary, -1 if not yet
+	inline long int GetTransient() { return stationary ? values : -1; }
+
+	//! Forget all values
+	void Clear();
+
+private:
+	//! Serialise using boost, for a checkpoint during the transient
+	friend class boost::serialization::access;
+
+	//! The serialise function has access to all fields
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version) {
+		ar & sum;
+		ar & count;
+		ar & values;
+		ar & means;
+		ar & stationary;
+	}
+
+	//! Close the current batch and test the window
+	void Batch();
+
+	//! Values per batch
+	long int batch_size;
+
+	//! Batches per window, an even number
+	int window;
+
+	//! Number of standard errors that the halves of the window may differ
+	double z;
+
+	//! Sum of the values in the current batch
+	double sum;
+
+	//! Number of values in the current batch
+	long int count;
+
+	//! Number of values so far
+	long int values;
+
+	//! Means of the last batches, at most a window
+	std::deque<double> means;
+
+	//! Set once the series is found to be stationary
+	bool stationary;
+};
+
+#endif /* STATIONARITY_H_ */
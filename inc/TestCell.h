@@ -26,7 +26,7 @@
 
 #include <Typedefs.h>
 
-class Grid;
+template <typename T> class Grid;
 
 /**
  * Gives access to private members of cell for testing purposes. This is not intended to be done on
@@ -34,7 +34,7 @@ class Grid;
  */
 class TestCell {
 public:
-	TestCell(Grid *grid);
+	TestCell(Grid<GrainType> *grid);
 
 	~TestCell();
 
@@ -42,7 +42,7 @@ public:
 	void SetHeight(int i, GrainType value);
 
 protected:
-	Grid *grid;
+	Grid<GrainType> *grid;
 };
 
 
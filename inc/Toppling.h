@@ -29,10 +29,17 @@
 #include <Grid.h>
 #include <Cell.h>
 #include <vector>
-#include <set>
-#include <EventCounter.hpp>
+#include <limits>
+#include <algorithm>
+#include <ActiveSet.h>
+#include <LogHistogram.hpp>
 
 #include <boost/random/mersenne_twister.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/array.hpp>
+#include <boost/serialization/vector.hpp>
 
 /* **************************************************************************************
  * Macros and forward declarations
@@ -45,7 +52,7 @@
 #undef EXTRA_ORDINARY_CHECKING
 #endif
 
-class Grid;
+template <typename T> class Grid;
 
 /* **************************************************************************************
  * Interface of Toppling
@@ -72,103 +79,200 @@ enum TopplingMethod { TM_UNDEFINED, Manna_Lin2010, Bak_Tang_Wiesenfeld1987, Lin_
  * - FOLLOW_ACTIVITY
  *    maintain a list of active sites and remove sites from the list if their values does
  *    not change anymore (can end up in infinite loop if there is e.g. no dissipation)
+ * - SYNCHRONOUS
+ *    all unstable sites topple at the same time, as in a cellular automaton, each step
+ *    goes over the entire grid (BTW on periodic or dissipating boundaries with the cells
+ *    stored row by row, otherwise the sites are picked at random as with RANDOM_ALL)
  */
-enum TopplingIterator { RANDOM_ALL, RANDOM_FRACTION, FOLLOW_ACTIVITY };
+enum TopplingIterator { RANDOM_ALL, RANDOM_FRACTION, FOLLOW_ACTIVITY, SYNCHRONOUS };
 
 std::ostream& operator<<( std::ostream& os, const TopplingMethod& method);
 
+/**
+ * The shape of an avalanche, measured while toppling. The radius of gyration and the
+ * bounding box are those of the cells that toppled, each cell counted once, in grid
+ * coordinates (with periodic boundaries an avalanche that wraps around looks larger). They
+ * are only calculated on request, see SetMeasureExtent, otherwise the box is all -1.
+ */
+struct AvalancheShape {
+	//! Number of topplings
+	long int size;
+
+	//! Number of different cells that toppled
+	long int area;
+
+	//! Number of waves with topplings, 0 if they are not counted, see SetMeasureWaves
+	long int waves;
+
+	//! Radius of gyration
+	double radius;
+
+	//! First and last column, and first and last row, of the cells that toppled
+	int left, right, top, bottom;
+
+	//! Largest side of the bounding box, 0 if no cell toppled or if it is not calculated
+	inline int GetExtent() {
+		if (right < 0) return 0;
+		return std::max(right - left, bottom - top) + 1;
+	}
+};
+
 
 /**
- * Goes over a sand_grid and topples according to a certain scheme.
+ * Goes over a sand_grid and topples according to a certain scheme. TopplingBase contains
+ * the settings that do not depend on the type of the heights, so they can be set without
+ * knowing which instantiation of Toppling<T> is used.
  */
-class Toppling {
+class TopplingBase {
 public:
-	//! Constructor Toppling
-	Toppling(Grid *grid);
+	//! Constructor TopplingBase for a grid with the given number of cells and context
+	TopplingBase(long int no_cells, SimulationContext & context);
 
-	//! Destructor ~Toppling
-	virtual ~Toppling();
+	//! Destructor ~TopplingBase
+	virtual ~TopplingBase();
 
 	//! Do the action
-	void Topple(long int & avalanche_size);
-
-	//! Activate or deactivate cell
-	void CheckCell(Cell & cell);
+	virtual void Topple(long int & avalanche_size) = 0;
 
 	//! Set toppling method
-	void SetTopplingMethod(TopplingMethod toppling_method);
+	virtual void SetTopplingMethod(TopplingMethod toppling_method) = 0;
 
 	//! Set iterator
 	void SetTopplingIterator(TopplingIterator toppling_iterator);
 
 	//! Overwrite toppling threshold
-	void SetTopplingThreshold(GrainType threshold);
+	virtual void SetTopplingThreshold(GrainType threshold) = 0;
 
 	//! Set dissipative mode
 	void SetDissipativeMode(bool mode);
 
-	//! PFT_Dissipation grid
-	inline void SetDissGrid(Grid &grid) { diss_grid = &grid; }
-
 	//! Define if we actually will count the grains during toppling
 	void SetCounterDuringAvalanches(bool count);
 
 	//! Event counter to count number of grains during avalanches...
-	inline EventCounter<int> *GetNoDuringAvalanches() { return noDuringAvalanches; };
+	inline LogHistogram<int> *GetNoDuringAvalanches() { return noDuringAvalanches; };
 
-	//! Set feed for grid (in RANDOM_ALL mode we go over all cells in random order)
-	inline static void SetGridFeed(int feed) { grid_feed = feed; }
+	//! Total number of grains that left the grid over the boundary (to the reservoir)
+	inline GrainType GetBoundaryOutflow() { return boundary_outflow; }
 
-	//! Set feed for neighbour order and dissipation
-	inline static void SetTopplingFeed(int feed) { toppling_feed = feed; }
+	//! Total number of grains that disappeared within the grid while toppling
+	inline GrainType GetBulkDissipation() { return bulk_dissipation; }
 
-	//! Get feed for grid for Boost randomizer
-	inline static int GetGridFeed() { return grid_feed; }
+	//! Count the waves of an avalanche, this is not possible with ToppleAbelian and the tiles
+	void SetMeasureWaves(bool measure);
 
-	//! Get feed for toppling
-	inline static int GetTopplingFeed() { return toppling_feed; }
+	//! Calculate the radius of gyration and the bounding box of the avalanches, or not
+	inline void SetMeasureExtent(bool measure) { measure_extent = measure; }
+
+	//! Size, area, waves and extent of the last avalanche
+	inline const AvalancheShape & GetShape() { return shape; }
 
 	//! Count the number of cells just below threshold
-	long int CountCriticalCells();
+	virtual long int CountCriticalCells() = 0;
 
 	//! Get topple threshold
-	inline GrainType GetToppleThreshold() { return topple_threshold; }
+	virtual GrainType GetToppleThreshold() = 0;
 
 	//! Set dissipation threshold
-	inline void SetDissipationThreshold(GrainType th) { diss_threshold = th; }
+	virtual void SetDissipationThreshold(GrainType th) = 0;
 
 	//! Set dissipation rate
 	inline void SetDissipationRate(double rate) { diss_rate = rate; }
 
 	//! Set dissipation amount of energy / number of grains
-	inline void SetDissipationAmount(GrainType amount) { diss_amount = amount; }
+	inline void SetDissipationAmount(GrainType amount) { diss_amount = amount; select_kernel = true; }
 
 	//! Get dissipation amount
 	inline GrainType GetDissipationAmount() { return diss_amount; }
 
 	//! Set dissipation cell capacity
-	void SetCellCapacity(GrainType capacity);
-protected:
-	//! Topple specific cell
-	bool Topple(Cell & cell, std::vector<Cell*> & neighbours);
-private:
-	//! Reference to sand_grid
-	Grid *sand_grid;
+	virtual void SetCellCapacity(GrainType capacity) = 0;
 
-	//! Reference to energy sand_grid
-	Grid *diss_grid;
+	//! Allow the dedicated relaxation for the deterministic BTW model (default: true)
+	inline void SetAbelian(bool abelian) { allow_abelian = abelian; select_kernel = true; }
+
+	//! Relax with one tile of the grid per thread, see SetThreads (default: false)
+	inline void SetTiled(bool tiled) { this->tiled = tiled; select_kernel = true; }
+
+	//! Number of threads that topple a wave of active cells together (default: 1) if it has at
+	//! least min_wave cells, this is not used by the dedicated BTW relaxation, see SetAbelian
+	virtual void SetThreads(int no_threads, long int min_wave = 256) = 0;
+
+protected:
+	/**
+	 * The cells that toppled for the first time in an avalanche, summed up: their number, the
+	 * sums of their coordinates and of the squares, and their bounding box.
+	 */
+	struct Extent {
+		long int area;
+		double x, y, squares;
+		int left, right, top, bottom;
+
+		//! No cells
+		inline void Clear() {
+			area = 0; x = y = squares = 0;
+			left = top = std::numeric_limits<int>::max();
+			right = bottom = -1;
+		}
+
+		//! Add the cell in column i and row j
+		inline void Add(int i, int j) {
+			area++; x += i; y += j; squares += (double)i*i + (double)j*j;
+			if (i < left) left = i;
+			if (i > right) right = i;
+			if (j < top) top = j;
+			if (j > bottom) bottom = j;
+		}
+
+		//! Add the cells of another extent, and clear that one
+		inline void Merge(Extent & other) {
+			area += other.area; x += other.x; y += other.y; squares += other.squares;
+			left = std::min(left, other.left); right = std::max(right, other.right);
+			top = std::min(top, other.top); bottom = std::max(bottom, other.bottom);
+			other.Clear();
+		}
+	};
+
+	//! Fill in the shape of the avalanche from its extent, and clear the extent
+	void SetShape(long int avalanche_size);
+
+	//! Serialise using boost
+	friend class boost::serialization::access;
+
+	//! Store or load the active cells, the order of the iterator, and what left the grid
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version) {
+		ar & active_cells;
+		if (random_indices != NULL)
+			ar & boost::serialization::make_array(random_indices, no_cells);
+		ar & boundary_outflow;
+		ar & bulk_dissipation;
+		if (noDuringAvalanches != NULL) ar & *noDuringAvalanches;
+	}
+
+	//! Number of cells in the grid
+	long int no_cells;
 
 	//! Events during avalanches
-	EventCounter<int> * noDuringAvalanches;
+	LogHistogram<int> * noDuringAvalanches;
 
 	//! It is expensive to count, so we should be able to turn it off
 	bool countDuringAvalanches;
 
-	//! Active cells
-	std::set<Cell*> active_cells;
+	//! Count the waves, so relax wave by wave
+	bool measure_waves;
 
-	//! Threshold
-	GrainType topple_threshold;
+	//! Calculate the radius and the bounding box of the cells that toppled
+	bool measure_extent;
+
+	//! Active cells (indices in the grid)
+	ActiveSet active_cells;
+
+	//! Use ToppleAbelian if possible
+	bool allow_abelian;
+
+	//! Use RelaxTiles if possible
+	bool tiled;
 
 	//! Turn on/off dissipative mode if possible in a model
 	bool dissipative_mode;
@@ -176,9 +280,6 @@ private:
 	//! Dissipation rate
 	double diss_rate;
 
-	//! Dissipation threshold (Rossum_diss type of toppling)
-	GrainType diss_threshold;
-
 	//! The number of grains / amount of energy dissipated to neighbours
 	GrainType diss_amount;
 
@@ -191,12 +292,446 @@ private:
 	//! An array with random_indices that is randomly shuffled all the time
 	int *random_indices;
 
-	//! Toppling feed
-	static int toppling_feed;
+	//! Set if the settings changed, so another kernel might have to be used
+	bool select_kernel;
+
+	//! Simulation context of the grid: order of the cells (FT_GRID), neighbour order and
+	//! dissipation (FT_TOPPLING)
+	SimulationContext *context;
+
+	//! Total of grains that went to the reservoir
+	GrainType boundary_outflow;
+
+	//! Total of grains that disappeared in the bulk
+	GrainType bulk_dissipation;
+
+	//! Cells that toppled in the current avalanche so far
+	Extent extent;
+
+	//! Shape of the last avalanche
+	AvalancheShape shape;
+};
+
+/**
+ * The toppling procedure on a grid with heights of type T. There are explicit
+ * instantiations for uint8_t, int32_t, float and double. For integer types every neighbour
+ * gets the same share of the grains on toppling (decrease / # neighbours, rounded down),
+ * for floating point types the stochastic models draw the shares at random.
+ *
+ * A cell that becomes unstable is activated by the toppling procedure itself, directly
+ * after it changed the height. Whoever changes heights from outside (e.g. SandPile::Drive)
+ * should call CheckCell for that cell.
+ *
+ * The relaxation itself is done by a kernel: an instantiation of Relax for one combination
+ * of toppling method, boundary type and iterator. The kernel is picked once after the
+ * settings changed, so within an avalanche there are no switches on these settings.
+ *
+ * With more than one thread (see SetThreads) large waves of the FOLLOW_ACTIVITY iterator
+ * are toppled in parallel on the lattice boundaries, see ToppleWave. For very large grids
+ * with periodic or dissipating boundaries the grid can be decomposed in tiles instead, see
+ * SetTiled and RelaxTiles. The SYNCHRONOUS iterator divides the rows over the threads,
+ * see RelaxSynchronous.
+ */
+template <typename T>
+class Toppling: public TopplingBase {
+public:
+	//! Constructor Toppling
+	Toppling(Grid<T> *grid);
+
+	//! Destructor ~Toppling
+	virtual ~Toppling();
+
+	//! Do the action
+	void Topple(long int & avalanche_size);
+
+	//! Activate or deactivate cell with given index, call after changing its height
+	inline void CheckCell(long int index) {
+		if (toppling_iterator != FOLLOW_ACTIVITY) return;
+		if (sand_grid->GetHeights()[index] < topple_threshold) active_cells.Erase(index);
+		else active_cells.Insert(index);
+	}
+
+	//! Set toppling method
+	void SetTopplingMethod(TopplingMethod toppling_method);
+
+	//! Overwrite toppling threshold
+	void SetTopplingThreshold(GrainType threshold);
+
+	//! PFT_Dissipation grid
+	inline void SetDissGrid(Grid<T> &grid) { diss_grid = &grid; }
+
+	//! Count the number of cells just below threshold
+	long int CountCriticalCells();
+
+	//! Get topple threshold
+	inline GrainType GetToppleThreshold() { return topple_threshold; }
+
+	//! Set dissipation threshold
+	inline void SetDissipationThreshold(GrainType th) { diss_threshold = th; }
+
+	//! Set dissipation cell capacity
+	void SetCellCapacity(GrainType capacity);
+
+	//! True if the dedicated relaxation for the deterministic BTW model will be used
+	bool IsAbelian();
+
+	//! Number of threads that topple a wave of active cells together (default: 1)
+	void SetThreads(int no_threads, long int min_wave = 256);
+protected:
+	/**
+	 * The state of one thread while toppling. The serial procedure has one lane that uses
+	 * the shared toppling generator, in a parallel wave every thread has its own lane with
+	 * its own generator (only used by Rossum2011_diss, the other methods draw their random
+	 * numbers per toppling, see FillRandom). Such a thread does not touch the active cells or
+	 * the reservoir, it keeps the cells that became unstable and the grains that left the grid
+	 * instead.
+	 * In the tiled mode a lane also owns the tile of cells from begin till end, grains for
+	 * the rows above and below the tile go to the halo rows.
+	 */
+	struct Lane {
+		//! The generator in use, either the shared one, or own_generator
+		boost::mt19937 *generator;
+
+		//! Generator of a thread in a parallel wave
+		boost::mt19937 own_generator;
+
+		//! Cells that are unstable after the thread changed their height
+		std::vector<long int> unstable;
+
+		//! Grains that went to the reservoir, still to be added to it
+		T outflow;
+
+		//! Grains that went to the reservoir, still to be added to the totals
+		GrainType boundary_outflow;
+
+		//! Grains that disappeared in the bulk, still to be added to the totals
+		GrainType bulk_dissipation;
+
+		//! Number of topplings
+		long int topplings;
+
+		//! Cells that toppled for the first time in this avalanche
+		Extent extent;
+
+		//! First cell of the tile, and one past the last cell
+		long int begin, end;
+
+		//! First cell of the row above the tile (0), and of the row below the tile (1)
+		long int halo_begin[2];
+
+		//! Grains for the row above (0) and below (1) the tile, per column
+		std::vector<T> halo[2];
+
+		//! Columns of the halo rows that received grains
+		std::vector<int> halo_columns[2];
+
+		//! Random words of the cells to topple, made in bulk by FillRandom
+		std::vector<uint32_t> random;
+
+		//! Counters of the cells to topple, for FillRandom
+		std::vector<uint32_t> counters;
+
+		//! Words of the toppling at hand, or NULL to make them in Topple
+		const uint32_t *words;
+
+		//! Distance between the words of one toppling in random
+		long int stride;
+
+		//! Changes to the height histogram of the grid, still to be merged into it
+		HeightHistogram<T> histogram;
+	};
+
+	/**
+	 * Where the changes of a toppling go to: directly to the grid and the active cells
+	 * (serial), to the lane (parallel wave), or to the lane and the halo rows (tiles).
+	 */
+	enum Route { ROUTE_SERIAL, ROUTE_WAVE, ROUTE_TILE };
+
+	//! Topple specific cell, given by its index in the grid and the indices of its neighbours
+	template <TopplingMethod M, TopplingIterator I, Route R>
+	bool Topple(long int index, const long int *neighbours, int no_neighbours, Lane & lane);
+
+	//! Mark a cell that toppled, and add it if it did not topple before in this avalanche
+	inline void Visit(long int index, Lane & lane) {
+		if (visited[index] == epoch) return;
+		visited[index] = epoch;
+		if (!measure_extent) { lane.extent.area++; return; }
+		int i, j;
+		sand_grid->GetCoordinates(index, i, j);
+		lane.extent.Add(i, j);
+	}
+
+	//! Activate or deactivate a cell right after its height changed (not the reservoir)
+	template <TopplingIterator I>
+	inline void Activate(long int index) {
+		if (I != FOLLOW_ACTIVITY) return;
+		if (index == sand_grid->GetReservoir()) return;
+		if (sand_grid->GetHeights()[index] < topple_threshold) active_cells.Erase(index);
+		else active_cells.Insert(index);
+	}
+
+	//! Increase the height of a cell and activate it if needed, see Route
+	template <TopplingIterator I, Route R>
+	inline void Increase(long int index, T number, Lane & lane) {
+		if (index == sand_grid->GetReservoir()) {
+			lane.boundary_outflow += number;
+			if (R == ROUTE_SERIAL) sand_grid->Increase(index, number);
+			else lane.outflow += number;
+			return;
+		}
+		if (R == ROUTE_SERIAL) {
+			sand_grid->Increase(index, number); Activate<I>(index);
+			return;
+		}
+		T *heights = sand_grid->GetHeights();
+		if (R == ROUTE_TILE) {
+			if ((index < lane.begin) || (index >= lane.end)) {
+				ToHalo(index, number, lane);
+				return;
+			}
+			// only once in the list of unstable cells, that is a stack here
+			T before = heights[index];
+			heights[index] += number;
+			if (histogram != NULL) lane.histogram.Move(before, heights[index]);
+			bool stable = (before < topple_threshold);
+			if (stable && (heights[index] >= topple_threshold)) lane.unstable.push_back(index);
+			return;
+		}
+		T before = heights[index];
+		heights[index] += number;
+		if (histogram != NULL) lane.histogram.Move(before, heights[index]);
+		if (heights[index] >= topple_threshold) lane.unstable.push_back(index);
+	}
+
+	//! Put grains for a cell outside the tile in one of the halo rows
+	inline void ToHalo(long int index, T number, Lane & lane) {
+		int h = ((index >= lane.halo_begin[0]) &&
+				(index < lane.halo_begin[0] + sand_grid->GetWidth())) ? 0 : 1;
+		int column = index - lane.halo_begin[h];
+		if (lane.halo[h][column] == 0) lane.halo_columns[h].push_back(column);
+		lane.halo[h][column] += number;
+	}
+
+	//! Decrease the height of a cell and deactivate it if needed, see Route
+	template <TopplingIterator I, Route R>
+	inline void Decrease(long int index, T number, Lane & lane) {
+		if (R == ROUTE_SERIAL) {
+			sand_grid->Decrease(index, number); Activate<I>(index);
+			return;
+		}
+		T *heights = sand_grid->GetHeights();
+		T before = heights[index];
+		heights[index] -= number;
+		if (histogram != NULL) lane.histogram.Move(before, heights[index]);
+		if (heights[index] >= topple_threshold) lane.unstable.push_back(index);
+	}
+
+	//! Number of random words a toppling with method M needs
+	template <TopplingMethod M>
+	static inline int RandomWords() {
+		int increase_words = std::numeric_limits<T>::is_integer ? 0 : 4;
+		switch (M) {
+		case Manna_Lin2010: case Lin_etal2006: return 4 + increase_words;
+		case Rossum2011: return increase_words;
+		default: return 0;
+		}
+	}
+
+	//! Make the random words for the next toppling of the given cells in bulk
+	template <TopplingMethod M>
+	void FillRandom(const long int *cells, long int no_cells, Lane & lane);
+
+	//! Relax the grid with method M, neighbours of boundary type B and iterator I
+	template <TopplingMethod M, BoundaryType B, TopplingIterator I>
+	void Relax(long int & avalanche_size);
+
+	//! Relax the grid with the Abelian property of the BTW model (order does not matter)
+	template <BoundaryType B>
+	void ToppleAbelian(long int & avalanche_size);
+
+	//! Heights below this are counted in an array during ToppleAbelian, see CountMove
+	static const int SmallHeights = 64;
+
+	//! A cell went from height before to after, count it in moves if both are small and whole
+	inline void CountMove(long int *moves, HeightHistogram<T> *bins, T before, T after) {
+		long int from = (long int)before, to = (long int)after;
+		if ((from == before) && (to == after) && ((unsigned long int)from < SmallHeights) &&
+				((unsigned long int)to < SmallHeights)) {
+			moves[from]--;
+			moves[to]++;
+		} else {
+			bins->Move(before, after);
+		}
+	}
+
+	//! Relax the BTW grid in synchronous steps, from one buffer of heights into the other
+	template <BoundaryType B>
+	void RelaxSynchronous(long int & avalanche_size);
+
+	//! One synchronous step for the rows from first_row till end_row
+	template <BoundaryType B>
+	void Sweep(Lane & lane, int first_row, int end_row);
+
+	//! One synchronous step for the band of rows of the given lane
+	template <BoundaryType B>
+	void SweepBand(int lane);
+
+	//! Height of a cell after a synchronous step, given its height and that of its neighbours
+	static inline T Step(T h, T north, T south, T west, T east, T threshold, T decrease,
+			T increase) {
+		int received = (north >= threshold) + (south >= threshold) + (west >= threshold) +
+				(east >= threshold);
+		return h - (h >= threshold) * decrease + received * increase;
+	}
+
+	//! Topple a wave of active cells with all threads, in two sub-waves of stripes
+	template <TopplingMethod M, BoundaryType B>
+	void ToppleWave(std::vector<long int> & wave, long int & avalanche_size);
+
+	//! Topple the cells in the stripes of the current colour that belong to the given lane
+	template <TopplingMethod M, BoundaryType B>
+	void ToppleStripes(int lane);
+
+	//! Relax the grid with one tile per thread, exchanging grains over the halo rows
+	template <TopplingMethod M, BoundaryType B>
+	void RelaxTiles(long int & avalanche_size);
+
+	//! Relax the tile of the given lane till the whole grid is stable
+	template <TopplingMethod M, BoundaryType B>
+	void RelaxTile(int lane);
+
+	//! Add the grains in a halo row of another lane to the given row of this lane
+	void Absorb(Lane & lane, Lane & from, int h, long int row_begin);
+
+	//! Add the outflow, dissipation and histogram of a lane to the totals (and grid if needed)
+	void Settle(Lane & lane);
+
+	//! Pick the kernel that fits the current settings
+	void SelectKernel();
+private:
+	//! Serialise using boost
+	friend class boost::serialization::access;
+
+	//! Store or load the state between avalanches, the settings are not part of it
+	template<class Archive>
+	void serialize(Archive & ar, const unsigned int version) {
+		TopplingBase::serialize(ar, version);
+		ar & topple_counts;
+		if (Archive::is_loading::value) {
+			std::fill(visited.begin(), visited.end(), 0);
+			epoch = 0;
+		}
+	}
+
+	//! A kernel relaxes the grid, see Relax and ToppleAbelian
+	typedef void (Toppling::*Kernel)(long int & avalanche_size);
+
+	//! Pick the kernel for method M, given the boundary type
+	template <TopplingMethod M>
+	Kernel SelectBoundary(BoundaryType boundary_type);
+
+	//! Pick the kernel for method M and boundary type B, given the iterator
+	template <TopplingMethod M, BoundaryType B>
+	Kernel SelectIterator();
+
+	//! True if the grid should be relaxed in tiles with the current settings
+	bool UseTiles();
+
+	//! Part of a parallel wave that is done by one lane, see ToppleStripes
+	typedef void (Toppling::*StripeKernel)(int lane);
+
+	//! Loop of a worker thread, it waits for the sub-waves and topples its stripes
+	void Work(int lane);
+
+	//! Stop and remove the worker threads
+	void StopWorkers();
+
+	//! Reference to sand_grid
+	Grid<T> *sand_grid;
+
+	//! Reference to energy sand_grid
+	Grid<T> *diss_grid;
+
+	//! Stack of unstable cells for ToppleAbelian
+	std::vector<long int> unstable_cells;
+
+	//! Per cell the number of times it toppled, the counter for its random words
+	std::vector<uint32_t> topple_counts;
+
+	//! Per cell the last avalanche (epoch) in which it toppled, see Visit
+	std::vector<uint32_t> visited;
+
+	//! Number of the current avalanche, it only wraps around after 2^32 avalanches
+	uint32_t epoch;
+
+	//! Width of the grid, the length of a row in the synchronous steps
+	long int width;
+
+	//! Counter-based generator for the random words of a toppling
+	const CounterRandom *counter_random;
+
+	//! Height histogram of the grid during an avalanche, NULL if the grid does not keep one
+	HeightHistogram<T> *histogram;
+
+	//! Threshold
+	T topple_threshold;
+
+	//! Dissipation threshold (Rossum_diss type of toppling)
+	T diss_threshold;
+
+	//! Lane of the serial procedure
+	Lane serial_lane;
+
+	//! One lane per thread for parallel waves, the first one is for the calling thread
+	std::vector<Lane> lanes;
+
+	//! Second buffer of heights for the synchronous steps
+	std::vector<T> next_heights;
+
+	//! A row of empty cells, as neighbours outside the grid in the synchronous steps
+	std::vector<T> quiet_row;
+
+	//! Heights before and after the current synchronous step
+	T *sweep_from, *sweep_to;
+
+	//! Cells of the current wave per stripe of rows
+	std::vector< std::vector<long int> > stripes;
+
+	//! For every row the stripe it belongs to
+	std::vector<int> stripe_of_row;
+
+	//! For every row the tile (lane) it belongs to
+	std::vector<int> tile_of_row;
+
+	//! Per tile if there are unstable cells after the last exchange of halo rows
+	std::vector<char> busy_tiles;
+
+	//! True if the waves can be toppled in parallel with the current settings
+	bool parallel_waves;
+
+	//! Waves with less cells are toppled by one thread, the overhead is not worth it
+	long int min_parallel_wave;
+
+	//! The threads next to the calling one
+	boost::thread_group *workers;
+
+	//! Start of a sub-wave, and its end
+	boost::barrier *start_barrier, *done_barrier;
+
+	//! Between relaxing the tiles and exchanging the halo rows
+	boost::barrier *tile_barrier;
+
+	//! Set to let the workers return
+	bool stop_workers;
+
+	//! Colour of the stripes in the current sub-wave (0 or 1)
+	int wave_colour;
 
-	//! Grid feed
-	static int grid_feed;
+	//! What the workers do in the current sub-wave
+	StripeKernel wave_kernel;
 
+	//! The kernel currently in use
+	Kernel kernel;
 };
 
 
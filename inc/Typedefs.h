@@ -24,13 +24,29 @@
 #ifndef TYPEDEFS_H_
 #define TYPEDEFS_H_
 
-//! Currently we use integers for the number of grains
-//typedef int GrainType;
-//! It can be made a template, but that's always so much work
-//! However, in case we need Cell<int> as well as Cell<double> in the same program it will
-//! be necessary
+// General files
+#include <stdint.h>
+
+//! The heights of the cells are stored as the type Cell, Grid, Toppling and SandPile are
+//! templated on. GrainType is used for what does not depend on that: parameters such as
+//! thresholds and amounts, and values calculated over the grid, such as the total number
+//! of grains.
 typedef double GrainType;
 
+/**
+ * The type in which the heights are stored, to be picked at runtime (see Config). Discrete
+ * models such as BTW need no more than a byte per cell. With integer heights every
+ * neighbour gets the same share of the grains on toppling, which is exactly what the
+ * discrete versions of the models do.
+ * <ul>
+ * <li>HT_DOUBLE				double (default)
+ * <li>HT_FLOAT				float
+ * <li>HT_INT32				int32_t
+ * <li>HT_UINT8				uint8_t
+ * </ul>
+ */
+enum HeightType { HT_DOUBLE, HT_FLOAT, HT_INT32, HT_UINT8 };
+
 
 
 #endif /* TYPEDEFS_H_ */
@@ -0,0 +1,83 @@
+/**
+ * @file ActiveSet.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+// General files
+#include <ActiveSet.h>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of ActiveSet
+ * **************************************************************************************/
+
+/**
+ * Both bitmaps use one bit per cell. The buffers are not reserved up front, they grow to the
+ * largest wave seen so far.
+ */
+ActiveSet::ActiveSet(long int size): count(0) {
+	long int words = (size + 63) / 64;
+	member.resize(words, 0);
+	queued.resize(words, 0);
+}
+
+/**
+ * Default destructor
+ */
+ActiveSet::~ActiveSet() { }
+
+/**
+ * The cells that are queued and are still a member form the new wave. The order is the
+ * order of insertion. The returned vector stays valid till the next call of NextWave, so
+ * cells can be inserted while going over it.
+ */
+vector<long int> & ActiveSet::NextWave() {
+	current.clear();
+	for (unsigned int i = 0; i < next.size(); ++i) {
+		long int index = next[i];
+		uint64_t bit = (uint64_t)1 << (index & 63);
+		queued[index >> 6] &= ~bit;
+		uint64_t & word = member[index >> 6];
+		if (word & bit) {
+			word &= ~bit;
+			current.push_back(index);
+		}
+	}
+	next.clear();
+	count = 0;
+	return current;
+}
+
+/**
+ * Remove all cells from the set and from the buffers.
+ */
+void ActiveSet::Clear() {
+	for (unsigned int i = 0; i < next.size(); ++i) {
+		long int index = next[i];
+		uint64_t bit = (uint64_t)1 << (index & 63);
+		queued[index >> 6] &= ~bit;
+		member[index >> 6] &= ~bit;
+	}
+	next.clear();
+	current.clear();
+	count = 0;
+}
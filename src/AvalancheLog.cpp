@@ -0,0 +1,270 @@
+/**
+ * @file AvalancheLog.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+// General files
+#include <AvalancheLog.h>
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <boost/bind.hpp>
+
+using namespace std;
+
+const char LOG_MAGIC[8] = { 'S', 'P', 'A', 'V', 'L', 'O', 'G', '1' };
+
+//! The lost grains are stored in 1/GRAIN_RESOLUTION grain
+static const uint64_t GRAIN_RESOLUTION = 1024;
+
+//! A buffer is handed to the writing thread when it has this many bytes
+static const size_t BLOCK_SIZE = 1 << 20;
+
+/* **************************************************************************************
+ * Implementation of AvalancheLogWriter
+ * **************************************************************************************/
+
+/**
+ * The header goes in the first buffer, like the records.
+ */
+AvalancheLogWriter::AvalancheLogWriter(const string & filename, int width, int height):
+		file(NULL), last_tick(0), written(0), busy(false), stop(false), writer(NULL) {
+	file = fopen(filename.c_str(), "wb");
+	if (file == NULL) {
+		cerr << "Could not create avalanche log \"" << filename << "\"" << endl;
+		return;
+	}
+	buffer.insert(buffer.end(), LOG_MAGIC, LOG_MAGIC + sizeof(LOG_MAGIC));
+	Put(width);
+	Put(height);
+	Put(GRAIN_RESOLUTION);
+	Start();
+}
+
+/**
+ * Whatever was written after the given length is cut off. The ticks of the records that
+ * follow are differences with the given tick, the tick of the last record that is kept.
+ */
+AvalancheLogWriter::AvalancheLogWriter(const string & filename, uint64_t length,
+		long int last_tick): file(NULL), last_tick(last_tick), written(length), busy(false),
+		stop(false), writer(NULL) {
+	file = fopen(filename.c_str(), "r+b");
+	if ((file == NULL) || (ftruncate(fileno(file), length) != 0) ||
+			(fseeko(file, length, SEEK_SET) != 0)) {
+		cerr << "Could not continue avalanche log \"" << filename << "\"" << endl;
+		if (file != NULL) fclose(file);
+		file = NULL;
+		return;
+	}
+	Start();
+}
+
+/**
+ * Default destructor, closes the file if that did not happen yet.
+ */
+AvalancheLogWriter::~AvalancheLogWriter() {
+	Close();
+}
+
+/**
+ * The buffers are reserved once, so they are not allocated again when they are swapped.
+ */
+void AvalancheLogWriter::Start() {
+	buffer.reserve(BLOCK_SIZE + 64);
+	pending.reserve(BLOCK_SIZE + 64);
+	writer = new boost::thread(boost::bind(&AvalancheLogWriter::Work, this));
+}
+
+/**
+ * The record is only coded here, it reaches the file when the buffer is full, or on Close.
+ */
+void AvalancheLogWriter::Write(const AvalancheRecord & record) {
+	if (file == NULL) return;
+	assert (record.tick >= last_tick);
+	Put(record.tick - last_tick);
+	last_tick = record.tick;
+	Put(record.site);
+	Put(record.size);
+	Put(record.area);
+	Put(record.duration);
+	int64_t lost = (int64_t)floor(record.lost * GRAIN_RESOLUTION + 0.5);
+	Put(((uint64_t)lost << 1) ^ (uint64_t)(lost >> 63));
+	if (buffer.size() >= BLOCK_SIZE) Hand();
+}
+
+/**
+ * The writing thread still has to take the previous buffer if the disk is slower than the
+ * simulation, only then this waits.
+ */
+void AvalancheLogWriter::Hand() {
+	boost::mutex::scoped_lock lock(mutex);
+	while (!pending.empty()) changed.wait(lock);
+	pending.swap(buffer);
+	changed.notify_all();
+}
+
+/**
+ * The writing thread takes the pending buffer and writes it without holding the lock, so in
+ * the mean time the next buffer can be filled.
+ */
+void AvalancheLogWriter::Work() {
+	vector<char> writing;
+	writing.reserve(BLOCK_SIZE + 64);
+	while (true) {
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			while (pending.empty() && !stop) changed.wait(lock);
+			if (pending.empty()) return;
+			writing.swap(pending);
+			busy = true;
+			changed.notify_all();
+		}
+		if (fwrite(&writing[0], 1, writing.size(), file) != writing.size()) {
+			cerr << "Could not write to avalanche log" << endl;
+		}
+		boost::mutex::scoped_lock lock(mutex);
+		written += writing.size();
+		writing.clear();
+		busy = false;
+		changed.notify_all();
+	}
+}
+
+/**
+ * After a flush, everything that is written so far is in the file and on the disk, so a
+ * checkpoint can refer to this length, also after a crash.
+ */
+uint64_t AvalancheLogWriter::Flush() {
+	if (file == NULL) return 0;
+	if (!buffer.empty()) Hand();
+	boost::mutex::scoped_lock lock(mutex);
+	while (!pending.empty() || busy) changed.wait(lock);
+	fflush(file);
+	fsync(fileno(file));
+	return written;
+}
+
+/**
+ * Hand over what is left, let the writing thread finish and close the file.
+ */
+void AvalancheLogWriter::Close() {
+	if (file == NULL) return;
+	if (!buffer.empty()) Hand();
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		stop = true;
+		changed.notify_all();
+	}
+	writer->join();
+	delete writer;
+	writer = NULL;
+	fclose(file);
+	file = NULL;
+}
+
+/* **************************************************************************************
+ * Implementation of AvalancheLogReader
+ * **************************************************************************************/
+
+/**
+ * The file is mapped read-only and read sequentially, so the kernel can read ahead.
+ */
+AvalancheLogReader::AvalancheLogReader(const string & filename): data(NULL), size(0),
+		begin(0), position(0), last_tick(0), width(0), height(0), resolution(1) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		cerr << "Could not open avalanche log \"" << filename << "\"" << endl;
+		return;
+	}
+	struct stat status;
+	if ((fstat(fd, &status) < 0) || (status.st_size < (off_t)sizeof(LOG_MAGIC))) {
+		cerr << "Not an avalanche log \"" << filename << "\"" << endl;
+		close(fd);
+		return;
+	}
+	size = status.st_size;
+	void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		cerr << "Could not map avalanche log \"" << filename << "\"" << endl;
+		return;
+	}
+	madvise(mapped, size, MADV_SEQUENTIAL);
+	data = (const unsigned char*)mapped;
+
+	uint64_t w, h;
+	position = sizeof(LOG_MAGIC);
+	if (memcmp(data, LOG_MAGIC, sizeof(LOG_MAGIC)) || !Get(w) || !Get(h) || !Get(resolution) ||
+			(resolution == 0)) {
+		cerr << "Not an avalanche log \"" << filename << "\"" << endl;
+		munmap(mapped, size);
+		data = NULL;
+		return;
+	}
+	width = w;
+	height = h;
+	begin = position;
+}
+
+/**
+ * Default destructor, unmaps the file.
+ */
+AvalancheLogReader::~AvalancheLogReader() {
+	if (data != NULL) munmap((void*)data, size);
+}
+
+/**
+ * The ticks are stored as differences, so the records can only be read in order.
+ */
+bool AvalancheLogReader::Next(AvalancheRecord & record) {
+	if (data == NULL) return false;
+	uint64_t delta, site, avalanche_size, area, duration, lost;
+	if (!Get(delta) || !Get(site) || !Get(avalanche_size) || !Get(area) || !Get(duration) ||
+			!Get(lost)) {
+		position = size;
+		return false;
+	}
+	last_tick += delta;
+	record.tick = last_tick;
+	record.site = site;
+	record.size = avalanche_size;
+	record.area = area;
+	record.duration = duration;
+	int64_t units = (int64_t)(lost >> 1) ^ -(int64_t)(lost & 1);
+	record.lost = units / (GrainType)resolution;
+	return true;
+}
+
+/**
+ * Go back to the first record.
+ */
+void AvalancheLogReader::Rewind() {
+	position = begin;
+	last_tick = 0;
+}
@@ -24,35 +24,12 @@
 
 #include <Cell.h>
 
-#include <boost/random/uniform_smallint.hpp>
-
-using namespace boost;
 using namespace std;
 
 /* **************************************************************************************
  * Implementation of Cell
  * **************************************************************************************/
 
-int Cell::direction_feed = 33480;
-
-
-Cell::Cell() {
-	height = 0;
-
-	// here 4 is neighbour size
-	static boost::mt19937 randomGenerator(direction_feed);
-	uniform_smallint<size_t> distr(0, 4-1);
-
-	direction = distr(randomGenerator);
-	max_capacity = 10;
-	altered_function = NULL;
-}
-
-/**
- * Default destructor
- */
-Cell::~Cell() { }
-
 /**
  * Transfer grains from "this" cell to the cell given as argument. It is because of
  * capacity constraints in the target cell and a limited number of grains in the source
@@ -60,17 +37,26 @@ Cell::~Cell() { }
  * Hence this function returns the actual number of grains transferred between the
  * two cells.
  */
-GrainType Cell::Transfer(Cell &cell, GrainType number) {
-	GrainType target_max = max_capacity - cell.GetHeight();
-	GrainType source_max = height;
+template <typename T>
+T Cell<T>::Transfer(Cell cell, T number) {
+	T target_max = *max_capacity - cell.GetHeight();
+	T source_max = *height;
 
-	GrainType transfer = target_max;
+	T transfer = target_max;
 	transfer = (transfer < number) ? transfer : number;
 	transfer = (transfer < source_max) ? transfer : source_max;
 
-	height -= transfer;
-	cell.height += transfer;
+	Decrease(transfer);
+	cell.Increase(transfer);
 
 	return transfer;
 }
 
+/* **************************************************************************************
+ * Explicit instantiations of Cell
+ * **************************************************************************************/
+
+template class Cell<uint8_t>;
+template class Cell<int32_t>;
+template class Cell<float>;
+template class Cell<double>;
@@ -26,6 +26,10 @@
 #include <Config.h>
 #include <Toppling.h>
 
+#include <sstream>
+#include <iomanip>
+#include <stdint.h>
+
 using namespace std;
 
 /* **************************************************************************************
@@ -38,6 +42,32 @@ string & FigureConfig::GetDescription() {
 	return type;
 }
 
+/**
+ * The key of a sandpile in the state cache. Only the fields that matter for the physics go
+ * in: the size, the model, the boundary, the type of the heights, the dissipation and the
+ * threshold, and how the ticks are skipped. The threads, the feeds or the figures do not.
+ * The fields are printed in full precision and hashed with 64-bit FNV-1a.
+ */
+string Config::GetStateKey() {
+	ostringstream fields;
+	fields << setprecision(17) << system_size << " " << (int)toppling_method << " " <<
+			(int)boundary_type << " " << (int)height_type << " " << dissipative_mode << " " <<
+			dissipation_rate << " " << dissipation_amount << " " <<
+			dissipation_cell_capacitity << " " << dissipation_total << " " <<
+			dissipation_threshold << " " << toppling_threshold << " " << (auto_skip ? -1 : skip);
+	// the cells are stored in the order of the layout, the default keeps the keys of before
+	if (grid_layout != GL_ROW_MAJOR) fields << " " << (int)grid_layout;
+	string s = fields.str();
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned int i = 0; i < s.size(); ++i) {
+		hash ^= (unsigned char)s[i];
+		hash *= 1099511628211ULL;
+	}
+	ostringstream key;
+	key << hex << setw(16) << setfill('0') << hash;
+	return key.str();
+}
+
 /**
  * Config whatever might seem relevant to the user.
  */
@@ -46,6 +76,26 @@ void Config::Print() {
 
 	cout << "[*] Boundary Type: " << boundary_type << endl;
 
+	cout << "[*] Height Type: " << height_type << endl;
+
+	cout << "[*] Threads per avalanche: " << no_threads << endl;
+
+	cout << "[*] Tile per thread? " << (tiled ? "yes" : "no") << endl;
+
+	cout << "[*] Trials at the same time: " << no_trial_threads << endl;
+
+	cout << "[*] Synchronous toppling? " << (synchronous ? "yes" : "no") << endl;
+
+	cout << "[*] Grid layout: " << grid_layout << endl;
+
+	cout << "[*] Grid memory: " << page_type << (first_touch ? ", first touched per thread" : "") << endl;
+
+	cout << "[*] Avalanche log? " << (avalanche_log ? "yes" : "no") << endl;
+
+	cout << "[*] Checkpoint every: " << checkpoint_interval << " ticks" << endl;
+
+	cout << "[*] State cache: " << (state_cache.empty() ? "none" : state_cache) << endl;
+
 	cout << "[*] Dissipation: " << (dissipative_mode ? "yes" : "no") << endl;
 
 	// If there is dissipation show relevant parameters
@@ -64,7 +114,8 @@ void Config::Print() {
 	if (toppling_threshold < 0) cout << "default" << endl;
 	else cout << toppling_threshold << endl;
 
-	cout << "[*] Skip the first " << skip << " items" << endl;
+	if (auto_skip) cout << "[*] Skip the items till the grains per cell are stationary" << endl;
+	else cout << "[*] Skip the first " << skip << " items" << endl;
 
 	cout << "[*] Number of pictures will be " << no_pics << endl;
 
@@ -0,0 +1,99 @@
+/**
+ * @file CounterRandom.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+// General files
+#include <CounterRandom.h>
+
+/* **************************************************************************************
+ * Implementation of CounterRandom
+ * **************************************************************************************/
+
+/**
+ * The key is (0,0) till SetKey is called.
+ */
+CounterRandom::CounterRandom() {
+	SetKey(0, 0);
+}
+
+/**
+ * Default destructor
+ */
+CounterRandom::~CounterRandom() { }
+
+/**
+ * The sequence of Next uses the counters (i, i>>32, 0, 1), so it does not overlap with the
+ * blocks for events, which have 0 as last word. The buffer is filled on the first call of
+ * Next.
+ */
+void CounterRandom::SetKey(uint32_t seed, uint32_t stream) {
+	key[0] = seed;
+	key[1] = stream;
+	SetPosition(0);
+}
+
+/**
+ * Fill the buffer with the blocks in which the given word is, and skip to that word.
+ */
+void CounterRandom::SetPosition(uint64_t words) {
+	position = words / BUFFER_SIZE;
+	Refill();
+	index = words % BUFFER_SIZE;
+}
+
+/**
+ * There is no dependency between the iterations, the rounds are unrolled by hand so the
+ * compiler can put several blocks in one vector register. The words of a block are stored
+ * apart (n words between them) to keep the stores contiguous.
+ */
+void CounterRandom::Blocks(const uint32_t *c0, const uint32_t *c1, uint32_t c2, uint32_t c3,
+		long int n, uint32_t *out) const {
+	const uint32_t key0 = key[0], key1 = key[1];
+	for (long int i = 0; i < n; ++i) {
+		uint32_t x0 = c0[i], x1 = c1[i], x2 = c2, x3 = c3;
+		uint32_t k0 = key0, k1 = key1;
+		Round(x0, x1, x2, x3, k0, k1); Round(x0, x1, x2, x3, k0, k1);
+		Round(x0, x1, x2, x3, k0, k1); Round(x0, x1, x2, x3, k0, k1);
+		Round(x0, x1, x2, x3, k0, k1); Round(x0, x1, x2, x3, k0, k1);
+		Round(x0, x1, x2, x3, k0, k1); Round(x0, x1, x2, x3, k0, k1);
+		Round(x0, x1, x2, x3, k0, k1); Round(x0, x1, x2, x3, k0, k1);
+		out[i] = x0;
+		out[n+i] = x1;
+		out[2*n+i] = x2;
+		out[3*n+i] = x3;
+	}
+}
+
+/**
+ * The next BUFFER_SIZE/4 blocks of the sequence, in one call to Blocks.
+ */
+void CounterRandom::Refill() {
+	const int blocks = BUFFER_SIZE / 4;
+	uint64_t first = position * blocks;
+	for (int b = 0; b < blocks; ++b) {
+		counters[0][b] = (uint32_t)(first + b);
+		counters[1][b] = (uint32_t)((first + b) >> 32);
+	}
+	Blocks(counters[0], counters[1], 0, 1, blocks, buffer);
+	position++;
+	index = 0;
+}
@@ -60,13 +60,13 @@ float DataContainer::CalculateSlope() {
 
 //	int x_max = 10000;
 
-	float sum = 0; int N = 0;
-	std::map<DataDecoratorType,int>::iterator it;
+	float sum = 0; double N = 0;
+	std::map<DataDecoratorType,double>::iterator it;
 	for (it = map_data->begin(); it != map_data->end(); ++it) {
 		int value = it->first;
 		if (value < x_min) continue;
 //		if (value > x_max) continue;
-		int count = it->second;
+		double count = it->second;
 		N += count;
 		sum += count * std::log(value * denom);
 	}
@@ -101,9 +101,9 @@ float DataContainer::item<float>(int index) {
  * if it is only used once for plotting or so, everything might be fine.
  */
 template<>
-pair<DataDecoratorType,int> DataContainer::item< pair<DataDecoratorType,int> >(int index) {
+pair<DataDecoratorType,double> DataContainer::item< pair<DataDecoratorType,double> >(int index) {
 	assert (dataType == DT_MAP);
-	std::map<DataDecoratorType,int>::iterator it( map_data->begin() );
+	std::map<DataDecoratorType,double>::iterator it( map_data->begin() );
 	std::advance( it, index );
 	return *it;
 }
@@ -136,7 +136,7 @@ void DataContainer::read(std::istream& in) { //, DataDecoratorType resolution) {
 	case DT_MAP:
 		assert (map_data != NULL);
 		map_data->clear();
-		int y;
+		double y;
 		in.imbue(std::locale(std::locale(), new colonsep));
 
 		while(in >> x >> y) {
@@ -144,7 +144,7 @@ void DataContainer::read(std::istream& in) { //, DataDecoratorType resolution) {
 //				int x_ins = (int)(x * resolution);
 //				x = x_ins / (DataDecoratorType)resolution;
 //			}
-			map_data->insert(make_pair<DataDecoratorType,int>(x, y));
+			map_data->insert(make_pair(x, y));
 			assert(y != 0);
 //			cout << "x and y: " << x << " and " << y << endl;
 		}
@@ -174,7 +174,7 @@ void DataContainer::read(std::istream& in) { //, DataDecoratorType resolution) {
  * Write map_data to a file
  */
 void DataContainer::write(std::ostream& out) {
-	std::map<DataDecoratorType,int>::const_iterator i;
+	std::map<DataDecoratorType,double>::const_iterator i;
 	out << fixed << setprecision (10);
 	switch(dataType) {
 	case DT_MAP:
@@ -207,16 +207,17 @@ void DataContainer::ApplyBins(int no_bins, DataDecoratorType min, DataDecoratorT
 
 //	write(std::cout);
 
-	std::map<DataDecoratorType,int>::const_iterator i;
+	std::map<DataDecoratorType,double>::const_iterator i;
 	EventCounter<DataDecoratorType> ec;
 	for (i = map_data->begin(); i != map_data->end(); ++i) {
-		ec.AddEvent(i->first, i->second);
+		ec.AddEvent(i->first, (long int)i->second);
 	}
 	ec.Bin(no_bins, min, max);
 
 	map_data->clear();
-	for (i = ec.getEvents().begin(); i != ec.getEvents().end(); ++i) {
-		map_data->insert(make_pair<DataDecoratorType,int>(i->first, i->second));
+	std::map<DataDecoratorType,long int>::const_iterator b;
+	for (b = ec.getEvents().begin(); b != ec.getEvents().end(); ++b) {
+		map_data->insert(make_pair(b->first, (double)b->second));
 	}
 
 //	cout << "After bins: " << endl;
@@ -24,37 +24,89 @@
 
 // General files
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <map>
+#include <cstdio>
+#include <unistd.h>
 
 #include <Experiment.h>
 #include <SandPile.h>
 #include <Time.h>
 
+#include <algorithm>
+
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
 using namespace std;
 
+/**
+ * Write the bytes to a temporary file next to the given one and rename it, so the file is
+ * either the old one or the complete new one, also after a crash.
+ */
+static bool WriteAtomically(const string & filename, const string & temporary,
+		const string & bytes) {
+	FILE *file = fopen(temporary.c_str(), "wb");
+	bool success = (file != NULL) &&
+			(fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size()) &&
+			(fflush(file) == 0) && (fsync(fileno(file)) == 0);
+	if ((file != NULL) && (fclose(file) != 0)) success = false;
+	return success && (rename(temporary.c_str(), filename.c_str()) == 0);
+}
+
+/**
+ * The grains per cell change slowly, a sandpile needs about L*L grains to change its mean
+ * height by one. A batch is half that many ticks, so in a window of ten batches a sandpile
+ * that still fills up gains several grains per cell, a clear trend.
+ */
+static long int BatchSize(const Config & config) {
+	return std::max(1, config.system_size * config.system_size / 2);
+}
+
 /* **************************************************************************************
  * Implementation of Experiment
  * **************************************************************************************/
 
 /**
  * Create a new experiment, by creating a new sandpile and the corresponding counters for
- * plotting.
+ * plotting. If the trials run in parallel, every trial creates its own sandpile later on.
  */
-Experiment::Experiment(Config & cfg): config(cfg) {
-	counters.clear();
+Experiment::Experiment(Config & cfg): config(cfg), context(cfg.feeds), sandpile(NULL),
+		show_progress(true), draw_pictures(true), next_trial(0), avalanche_log(NULL),
+		checkpoints(false), log_length(0), log_tick(0), skip(cfg.skip),
+		stationarity(BatchSize(cfg)) {
+	CreateCounters();
+	if ((config.no_trial_threads <= 1) || (config.no_trials <= 1)) CreateSandPile();
+	checkpoints = (config.checkpoint_interval > 0) && (sandpile != NULL);
+}
 
-	if (config.feeds.size() >= 6) {
-		Toppling::SetGridFeed(config.feeds[0]);
-		Toppling::SetTopplingFeed(config.feeds[1]);
-		Cell::SetDirectionFeed(config.feeds[2]);
-		SandPile::SetDriveFeed(config.feeds[3]);
-		SandPile::SetDissipationFeed(config.feeds[4]);
-		Grid::SetNeighbourFeed(config.feeds[5]);
-	} else {
-		cerr << "Not enough feeds for random generators!" << endl;
-	}
+/**
+ * The trial has its own context, with the feeds from the configuration and the number of the
+ * trial as stream. Only the first trial draws pictures, they would overwrite each other
+ * anyway. Dots from several threads make no sense, so there is no progress bar.
+ */
+Experiment::Experiment(Config & cfg, int trial): config(cfg), context(cfg.feeds, trial),
+		sandpile(NULL), show_progress(false), draw_pictures(trial == 0), next_trial(0),
+		avalanche_log(NULL), checkpoints(false), log_length(0), log_tick(0), skip(cfg.skip),
+		stationarity(BatchSize(cfg)) {
+	CreateCounters();
+	CreateSandPile();
+}
 
-	sandpile = new SandPile(config.system_size, config.toppling_method, config.boundary_type);
+/**
+ * Create the sandpile and set it up with the parameters from the configuration.
+ */
+void Experiment::CreateSandPile() {
+	sandpile = SandPileBase::Create(context, config.height_type, config.system_size,
+			config.toppling_method, config.boundary_type, config.grid_layout,
+			GridAllocator(config.page_type, config.first_touch ? config.no_threads : 1));
+	if (show_progress) cout << "Cells asking for " << config.page_type << ", on pages of " <<
+			(sandpile->GetPageSize() >> 10) << " kB" << endl;
 
 //	cout << "config.dissipation_total = " << config.dissipation_total << endl;
 //	cout << "config.dissipation_cell_capacity = " << config.dissipation_cell_capacitity << endl;
@@ -64,28 +116,66 @@ Experiment::Experiment(Config & cfg): config(cfg) {
 	sandpile->GetToppling()->SetCellCapacity(config.toppling_threshold * 4);
 	sandpile->GetToppling()->SetDissipationRate(config.dissipation_rate);
 	sandpile->GetToppling()->SetDissipationAmount(config.dissipation_amount);
+	sandpile->GetToppling()->SetThreads(config.no_threads);
+	sandpile->GetToppling()->SetTiled(config.tiled);
+	if (config.synchronous) sandpile->GetToppling()->SetTopplingIterator(SYNCHRONOUS);
+	// counting the waves rules out the faster relaxation procedures, so only if it is needed
+	// (the duration figure is not in the defaults, see AddShapeFigures)
+	sandpile->GetToppling()->SetMeasureWaves(config.avalanche_log ||
+			(counters.find(PFT_AvalancheDuration) != counters.end()));
+	sandpile->GetToppling()->SetMeasureExtent(
+			(counters.find(PFT_AvalancheRadius) != counters.end()) ||
+			(counters.find(PFT_AvalancheExtent) != counters.end()));
+
+	// the grid keeps the number of cells per height itself, rather than counting them each time
+	if ((counters.find(PFT_GrainsPerCell) != counters.end()) ||
+			(counters.find(PFT_CriticalCells) != counters.end()))
+		sandpile->SetHeightHistogram(true);
 
 	if (sandpile->GetDissToppling())
 		sandpile->GetDissToppling()->SetCellCapacity(config.dissipation_cell_capacitity);
 
-	counters.insert(make_pair<PlotFigureType,EventCounter<CounterType> *>(
-			PFT_GrainsBeforeAvalanche,new EventCounter<CounterType>()));
-	counters.insert(make_pair<PlotFigureType,EventCounter<CounterType>*>(
-			PFT_GrainsDiffAvalanche,new EventCounter<CounterType>()));
-	counters.insert(make_pair<PlotFigureType,EventCounter<CounterType>*>(
-			PFT_GrainsPerCell,new EventCounter<CounterType>()));
-	counters.insert(make_pair<PlotFigureType,EventCounter<CounterType>*>(
-			PFT_Avalanche,new EventCounter<CounterType>()));
-	counters.insert(make_pair<PlotFigureType,EventCounter<CounterType>*>(
-			PFT_CriticalCells,new EventCounter<CounterType>()));
-
-//	counters.insert(make_pair<PlotFigureType,EventCounter<CounterType>*>(
-//			PFT_GrainsDuringAvalanche,sandpile->GetGrainsDuringAvalanches()));
-
 	// After random generator initialisation
 	if (sandpile->GetDissToppling())
 		sandpile->Populate(config.dissipation_total/5, 5);
+}
 
+/**
+ * The counters for the figures, one per figure type. The grains are counted per cell, so
+ * the unit is one grain on the whole grid and every number of grains has its own bucket.
+ * The height per cell is truncated to a thousandth of a grain, see CountHeights. The totals
+ * of grains vary little around their mean, so they are counted with a finer precision.
+ * The radius of gyration of an avalanche is counted in hundredths of a cell. Its duration,
+ * radius and extent are only counted if there is a figure for them, see CreateSandPile.
+ */
+void Experiment::CreateCounters() {
+	counters.clear();
+	double L2 = config.system_size * config.system_size;
+
+	counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType> *>(
+			PFT_GrainsBeforeAvalanche,new LogHistogram<CounterType>(1/L2, 11)));
+	counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+			PFT_GrainsDiffAvalanche,new LogHistogram<CounterType>(1/L2)));
+	counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+			PFT_GrainsPerCell,new LogHistogram<CounterType>(0.001, 12)));
+	counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+			PFT_Avalanche,new LogHistogram<CounterType>()));
+	counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+			PFT_CriticalCells,new LogHistogram<CounterType>(1/L2)));
+	counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+			PFT_AvalancheArea,new LogHistogram<CounterType>()));
+	if (config.figures.find(PFT_AvalancheDuration) != config.figures.end())
+		counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+				PFT_AvalancheDuration,new LogHistogram<CounterType>()));
+	if (config.figures.find(PFT_AvalancheRadius) != config.figures.end())
+		counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+				PFT_AvalancheRadius,new LogHistogram<CounterType>(0.01)));
+	if (config.figures.find(PFT_AvalancheExtent) != config.figures.end())
+		counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+				PFT_AvalancheExtent,new LogHistogram<CounterType>()));
+
+//	counters.insert(make_pair<PlotFigureType,LogHistogram<CounterType>*>(
+//			PFT_GrainsDuringAvalanche,sandpile->GetGrainsDuringAvalanches()));
 }
 
 /**
@@ -93,7 +183,7 @@ Experiment::Experiment(Config & cfg): config(cfg) {
  * is part of the sandpile.
  */
 Experiment::~Experiment() {
-	std::map<PlotFigureType,EventCounter<CounterType>*>::iterator i;
+	std::map<PlotFigureType,LogHistogram<CounterType>*>::iterator i;
 	for (i = counters.begin(); i != counters.end(); ++i) {
 		if (i->first != PFT_GrainsDuringAvalanche)
 			delete i->second;
@@ -101,6 +191,7 @@ Experiment::~Experiment() {
 	counters.clear();
 
 	// Destruction...
+	delete avalanche_log;
 	delete sandpile;
 
 }
@@ -110,11 +201,11 @@ Experiment::~Experiment() {
  * subsequent avalanche with some additional calculations for plotting.
  */
 void Experiment::Tick(long int t) {
-	std::map<PlotFigureType,EventCounter<CounterType>*>::const_iterator i;
-	std::map<PlotFigureType,EventCounter<CounterType>*>::const_iterator j;
-	std::map<PlotFigureType,EventCounter<CounterType>*>::const_iterator k;
-	std::map<PlotFigureType,EventCounter<CounterType>*>::const_iterator l;
-	std::map<PlotFigureType,EventCounter<CounterType>*>::const_iterator m;
+	std::map<PlotFigureType,LogHistogram<CounterType>*>::const_iterator i;
+	std::map<PlotFigureType,LogHistogram<CounterType>*>::const_iterator j;
+	std::map<PlotFigureType,LogHistogram<CounterType>*>::const_iterator k;
+	std::map<PlotFigureType,LogHistogram<CounterType>*>::const_iterator l;
+	std::map<PlotFigureType,LogHistogram<CounterType>*>::const_iterator m;
 
 	int L2 = config.system_size * config.system_size;
 	// Do we need to calculate grains before the avalanche?
@@ -151,8 +242,27 @@ void Experiment::Tick(long int t) {
 		sandpile->GetValue(cells, GVT_CRITICAL_CELLS);
 	}
 
+	// Grains that left so far, the log stores the grains lost in the avalanche
+	TopplingBase *toppling = sandpile->GetToppling();
+	GrainType lost_before = 0;
+	if (avalanche_log != NULL)
+		lost_before = toppling->GetBoundaryOutflow() + toppling->GetBulkDissipation();
+
 	// Calculate the actual avalanche
-	int avalanche_size = sandpile->Relax(t > config.skip);
+	AvalancheShape shape;
+	int avalanche_size = sandpile->Relax(shape, t > skip);
+
+	if ((avalanche_size > 0) && (avalanche_log != NULL)) {
+		AvalancheRecord record;
+		record.tick = t;
+		record.site = sandpile->GetDriveSite();
+		record.size = avalanche_size;
+		record.area = shape.area;
+		record.duration = shape.waves;
+		record.lost = toppling->GetBoundaryOutflow() + toppling->GetBulkDissipation() -
+				lost_before;
+		avalanche_log->Write(record);
+	}
 
 	if (avalanche_size > 0) {
 		if (calculate_before)
@@ -180,25 +290,30 @@ void Experiment::Tick(long int t) {
 		}
 
 		if (calculate_grains_per_cell) {
-			int L = config.system_size;
-			int patch_L = 1; // 4x4
-			dp.len = (L*L) / (patch_L*patch_L);
-			dp.values = new float[dp.len];
-			sandpile->Coarsen(dp.values, dp.len, patch_L);
-
-			float resolution = 1000;
-
-			for (int i = 0; i < dp.len; ++i) {
-				float val = (int)(dp.values[i] * resolution) / resolution;
-				m->second->AddEvent(val);
-			}
-			delete [] dp.values;
+			sandpile->CountHeights(*m->second);
 		}
 
+		std::map<PlotFigureType,LogHistogram<CounterType>*>::const_iterator s;
+		s = counters.find(PFT_AvalancheArea);
+		if (s != counters.end()) s->second->AddEvent(shape.area);
+		s = counters.find(PFT_AvalancheDuration);
+		if (s != counters.end()) s->second->AddEvent(shape.waves);
+		s = counters.find(PFT_AvalancheRadius);
+		if (s != counters.end()) s->second->AddEvent(shape.radius);
+		s = counters.find(PFT_AvalancheExtent);
+		if (s != counters.end()) s->second->AddEvent(shape.GetExtent());
+
+	}
+
+	// Measure from the next tick on, once the grains per cell are stationary
+	if (config.auto_skip && !stationarity.IsStationary()) {
+		long int grains;
+		sandpile->GetValue(grains, GVT_HEIGHT_SCALED);
+		if (stationarity.Add(grains / (double)L2)) skip = t;
 	}
 
 	// Show progress with "ppm" files, these are no diagrams
-	if (!(t % (config.timespan/config.no_pics))) {
+	if (draw_pictures && !(t % (config.timespan/config.no_pics))) {
 		dp.len = config.system_size*config.system_size;
 		dp.values = new float[dp.len];
 		dp.time_id = t;
@@ -215,27 +330,70 @@ void Experiment::Tick(long int t) {
 }
 
 /**
- * Basically times everything and shows a "progress bar"...
+ * Basically times everything and shows a "progress bar"... A trial that continues from a
+ * checkpoint does not start with an empty sandpile, and continues the log of the avalanches.
+ *
+ * With auto_skip, the ticks are skipped till the grains per cell are stationary, see Tick,
+ * so at first all ticks are skipped. A sandpile from the state cache is stationary already.
  */
-void Experiment::Trial(int trial) {
+void Experiment::Trial(int trial, long int start) {
+	bool resumed = (start > 0);
+	if (!resumed) {
+		skip = config.auto_skip ? config.timespan : config.skip;
+		stationarity.Clear();
+	}
+
+	// Perform the experiment, from a stationary sandpile if there is one in the cache
+	bool store_state = false;
+	if (!resumed && LoadState()) {
+		if (config.auto_skip) {
+			skip = -1;
+			stationarity.SetStationary();
+		}
+		start = skip + 1;
+	} else {
+		if (!resumed) sandpile->Clear();
+		store_state = !config.state_cache.empty() && (start <= skip);
+	}
 
-	// Perform the experiment
-	sandpile->Clear();
+	// Every trial has its own log, trials can run at the same time
+	if (config.avalanche_log) {
+		string filename = boost::lexical_cast<std::string>(config.run_id) + "/avalanches_" +
+				boost::lexical_cast<std::string>(trial) + ".log";
+		if (!resumed)
+			avalanche_log = new AvalancheLogWriter(filename, config.system_size,
+					config.system_size);
+		else
+			avalanche_log = new AvalancheLogWriter(filename, log_length, log_tick);
+	}
 
-	cout << "Progress [" << trial << "]: " << endl;
+	if (show_progress) cout << "Progress [" << trial << "]: " << endl;
 	timer.Start();
-	for (long int t = 0; t < config.timespan; ++t) {
+	for (long int t = start; t < config.timespan; ++t) {
 		Tick(t);
-		if (!(t % (config.timespan/config.no_dots))) {
+		if (store_state && (t == skip)) StoreState(trial);
+		if (show_progress && !(t % (config.timespan/config.no_dots))) {
 			cout << "."; flush(cout);
 		}
+		if (checkpoints && !((t + 1) % config.checkpoint_interval) && (t + 1 < config.timespan))
+			StoreCheckpoint(trial, t + 1);
 	}
 	// Flush the status bar
-	cout << endl;
+	if (show_progress) cout << endl;
+	if (config.auto_skip && show_progress) {
+		if (stationarity.IsStationary()) cout << "Transient: " << skip + 1 << " ticks" << endl;
+		else cerr << "Trial [" << trial << "] did not become stationary" << endl;
+	}
+
+	delete avalanche_log;
+	avalanche_log = NULL;
+
+	// The next trial starts from scratch, but the counters go on
+	if (checkpoints) StoreCheckpoint(trial + 1, 0);
 
 	// Measure the time the experiment took
 	timer.Stop();
-	timer.Print();
+	if (show_progress) timer.Print();
 }
 
 /**
@@ -244,22 +402,236 @@ void Experiment::Trial(int trial) {
  * they'd like to.
  */
 bool Experiment::Run() {
-	for (int trial = 0; trial < config.no_trials; trial++) {
-		Trial(trial);
+	if (sandpile == NULL) {
+		if (config.checkpoint_interval > 0)
+			cerr << "Checkpoints are only stored if the trials run one after the other" << endl;
+		RunParallel();
+	} else {
+		int first_trial = 0;
+		long int first_tick = 0;
+		std::ifstream checkpoint(CheckpointFile().c_str());
+		if (checkpoint.good()) {
+			checkpoint.close();
+			if (!LoadCheckpoint(first_trial, first_tick)) return false;
+			cout << "Continue trial " << first_trial << " at tick " << first_tick << endl;
+		}
+		for (int trial = first_trial; trial < config.no_trials; trial++) {
+			Trial(trial, (trial == first_trial) ? first_tick : 0);
+		}
 	}
 	Plot();
+	if (checkpoints) remove(CheckpointFile().c_str());
 	return true;
 }
 
 /**
- * Plot data from all "registered" counters.
+ * There is one checkpoint per run, a new one replaces the previous one.
+ */
+string Experiment::CheckpointFile() {
+	return boost::lexical_cast<std::string>(config.run_id) + "/checkpoint.bin";
+}
+
+/**
+ * A checkpoint contains everything that changes during a run: the random generators, the
+ * grids and the state of the toppling procedures, the counters, the length of the avalanche
+ * log and the tick at which to continue. The settings are in the configuration of the run.
+ * The checkpoint is written to a temporary file first and then renamed, so a crash while
+ * writing leaves the previous checkpoint intact.
+ */
+void Experiment::StoreCheckpoint(int trial, long int t) {
+	std::ostringstream data;
+	{
+		boost::archive::binary_oarchive ar(data);
+		ar << config.system_size << config.toppling_method << config.height_type;
+		ar << trial << t;
+		ar << skip << stationarity;
+		ar << context;
+		sandpile->StoreState(ar);
+		int no_counters = counters.size();
+		ar << no_counters;
+		std::map<PlotFigureType,LogHistogram<CounterType>*>::iterator i;
+		for (i = counters.begin(); i != counters.end(); ++i) {
+			PlotFigureType type = i->first;
+			ar << type << *i->second;
+		}
+		uint64_t length = 0;
+		long int last_tick = 0;
+		if (avalanche_log != NULL) {
+			length = avalanche_log->Flush();
+			last_tick = avalanche_log->GetLastTick();
+		}
+		ar << length << last_tick;
+	}
+
+	string filename = CheckpointFile();
+	if (!WriteAtomically(filename, filename + ".tmp", data.str())) {
+		cerr << "Could not store checkpoint \"" << filename << "\"" << endl;
+	}
+}
+
+/**
+ * The sandpile and the counters are created from the configuration of the run, so they have
+ * the right types and sizes already, the checkpoint only fills them in.
+ */
+bool Experiment::LoadCheckpoint(int & trial, long int & t) {
+	string filename = CheckpointFile();
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	try {
+		boost::archive::binary_iarchive ar(file);
+		int system_size;
+		TopplingMethod toppling_method;
+		HeightType height_type;
+		ar >> system_size >> toppling_method >> height_type;
+		if ((system_size != config.system_size) || (toppling_method != config.toppling_method) ||
+				(height_type != config.height_type)) {
+			cerr << "Checkpoint \"" << filename << "\" is of another configuration" << endl;
+			return false;
+		}
+		ar >> trial >> t;
+		ar >> skip >> stationarity;
+		ar >> context;
+		sandpile->LoadState(ar);
+		int no_counters;
+		ar >> no_counters;
+		for (int c = 0; c < no_counters; ++c) {
+			PlotFigureType type;
+			LogHistogram<CounterType> counter;
+			ar >> type >> counter;
+			std::map<PlotFigureType,LogHistogram<CounterType>*>::iterator i = counters.find(type);
+			if (i != counters.end()) *i->second = counter;
+		}
+		ar >> log_length >> log_tick;
+	} catch (boost::archive::archive_exception & e) {
+		cerr << "Could not load checkpoint \"" << filename << "\": " << e.what() << endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Trials are independent, so they can run at the same time. Each trial has its own
+ * sandpile and its own SimulationContext (the number of the trial is the stream), so the
+ * result does not depend on which thread runs which trial. A trial starts with an empty
+ * grid, just as after Clear in the serial case, but the streams of the trials differ from
+ * those of a serial run, where the next trial continues where the last one stopped.
+ */
+void Experiment::RunParallel() {
+	next_trial = 0;
+	int no_threads = std::min(config.no_trial_threads, config.no_trials);
+	cout << "Run " << config.no_trials << " trials on " << no_threads << " threads" << endl;
+	boost::thread_group threads;
+	for (int i = 0; i < no_threads; ++i) {
+		threads.create_thread(boost::bind(&Experiment::Work, this));
+	}
+	threads.join_all();
+}
+
+/**
+ * Pick the next trial, run it, and add its counters to those of this experiment. The
+ * counters only add up events, so the order in which trials finish does not matter.
+ */
+void Experiment::Work() {
+	while (true) {
+		int trial;
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			trial = next_trial++;
+		}
+		if (trial >= config.no_trials) return;
+
+		Experiment part(config, trial);
+		part.Trial(trial);
+
+		boost::mutex::scoped_lock lock(mutex);
+		std::map<PlotFigureType,LogHistogram<CounterType>*>::iterator i, j;
+		for (i = counters.begin(); i != counters.end(); ++i) {
+			j = part.counters.find(i->first);
+			if (j != part.counters.end()) i->second->Merge(*j->second);
+		}
+		cout << "Trial [" << trial << "] done, ";
+		if (config.auto_skip) {
+			if (part.stationarity.IsStationary()) cout << "transient " << part.skip + 1 << " ticks, ";
+			else cout << "not stationary, ";
+		}
+		part.timer.Print();
+	}
+}
+
+/**
+ * Plot data from all "registered" counters. A plain plot shows the distribution itself, so
+ * it gets the events per unit, otherwise the wider buckets of the histogram would stick out.
+ * The (cumulative) densities add up the counts themselves.
  */
 void Experiment::Plot() {
-	std::map<PlotFigureType,EventCounter<CounterType>*>::iterator i;
+	std::map<PlotFigureType,LogHistogram<CounterType>*>::iterator i;
 	for (i = counters.begin(); i != counters.end(); ++i) {
-		dp.events = &i->second->getEvents();
+		std::map<PlotFigureType,FigureConfig>::iterator f = config.figures.find(i->first);
+		bool per_unit = (f != config.figures.end()) && (f->second.plot_type == PT_DEFAULT);
+		dp.events = &i->second->getEvents(per_unit);
 		dp.id = config.run_id;
 		plot_figure.Draw(dp, config, i->first);
 	}
 }
 
+/**
+ * The files in the cache are named after the key of the configuration.
+ */
+string Experiment::StateFile() {
+	return config.state_cache + "/" + config.GetStateKey() + ".cells";
+}
+
+/**
+ * Only the cells of the sandpile are stored: the heights, the directions and the capacities.
+ * The random generators, the toppling counters and the histograms are not, a trial that
+ * starts from the cache goes on with those of its own, so its stream stays fresh. Trials
+ * that run at the same time write their own temporary file, the last one to finish replaces
+ * the other.
+ */
+void Experiment::StoreState(int trial) {
+	string filename = StateFile();
+	if (std::ifstream(filename.c_str()).good()) return;
+
+	std::ostringstream data;
+	{
+		boost::archive::binary_oarchive ar(data);
+		string key = config.GetStateKey();
+		ar << key;
+		sandpile->StoreCells(ar);
+	}
+
+	boost::system::error_code error;
+	boost::filesystem::create_directories(config.state_cache, error);
+	string temporary = filename + "." + boost::lexical_cast<std::string>(trial) + ".tmp";
+	if (!WriteAtomically(filename, temporary, data.str())) {
+		cerr << "Could not store state \"" << filename << "\"" << endl;
+		return;
+	}
+	if (show_progress) cout << "Stored state \"" << filename << "\"" << endl;
+}
+
+/**
+ * The sandpile of the trial is created from the configuration, so it has the right type and
+ * size already, the state only fills in the cells of the grids.
+ */
+bool Experiment::LoadState() {
+	if (config.state_cache.empty()) return false;
+	string filename = StateFile();
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file.good()) return false;
+	try {
+		boost::archive::binary_iarchive ar(file);
+		string key;
+		ar >> key;
+		if (key != config.GetStateKey()) {
+			cerr << "State \"" << filename << "\" is of another configuration" << endl;
+			return false;
+		}
+		sandpile->LoadCells(ar);
+	} catch (boost::archive::archive_exception & e) {
+		cerr << "Could not load state \"" << filename << "\": " << e.what() << endl;
+		sandpile->Clear();
+		return false;
+	}
+	if (show_progress) cout << "Start from state \"" << filename << "\"" << endl;
+	return true;
+}
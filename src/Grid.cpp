@@ -29,27 +29,14 @@
 #include <math.h>
 #include <iomanip>
 
+#include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_smallint.hpp>
 
 using namespace std;
 using namespace boost;
 
-int Grid::neighbour_feed = 334340;
-
-/**
- * Randomize neighbours over grid
- */
-ptrdiff_t boost_random_neigh (ptrdiff_t size) {
-	static boost::mt19937 randomGenerator(Grid::GetNeighbourFeed());
-	uniform_smallint<size_t> distr(0, size-1);
-	return distr(randomGenerator);
-}
-
-// pointer object to it:
-ptrdiff_t (*p_boost_random_neigh)(ptrdiff_t) = boost_random_neigh;
-
 /* **************************************************************************************
- * Implementation of Grid
+ * Implementation of GridBase
  * **************************************************************************************/
 
 std::ostream& operator<<( std::ostream& os, const BoundaryType& type ){
@@ -65,42 +52,158 @@ std::ostream& operator<<( std::ostream& os, const BoundaryType& type ){
 	return os;
 }
 
+std::ostream& operator<<( std::ostream& os, const HeightType& type ){
+	switch(type) {
+	case HT_DOUBLE: os << "double"; break;
+	case HT_FLOAT: os << "float"; break;
+	case HT_INT32: os << "int32"; break;
+	case HT_UINT8: os << "uint8"; break;
+	}
+	return os;
+}
+
+std::ostream& operator<<( std::ostream& os, const GridLayout& layout ){
+	switch(layout) {
+	case GL_ROW_MAJOR: os << "row by row"; break;
+	case GL_TILED: os << "tiles of 64x64"; break;
+	}
+	return os;
+}
+
+const int GridBase::TileSide;
+
 /**
  * Construct a grid with width*height cells and of a certain boundary type. There are
  * periodic and dissipating boundaries. The former makes the grid a kind of "Mobiüs"
  * strip, but then two-dimensional. And the latter connects all boundaries to a
- * reservoir.
+ * reservoir. The layout decides where a cell is stored, the neighbour table is made for it.
  */
-Grid::Grid(int width, int height, BoundaryType boundary_type) {
-	cout << "Create cells " << width << "*" << height << " (total=" << width * height << ") and type " << boundary_type << endl;
+GridBase::GridBase(int width, int height, BoundaryType boundary_type,
+		SimulationContext & context, GridLayout layout, const GridAllocator & allocator):
+		layout(layout), context(&context), allocator(allocator) {
+	cout << "Create cells " << width << "*" << height << " (total=" << (long int)width * height << ") and type " << boundary_type << endl;
 	this->width = width;
 	this->height = height;
-	int size = width * height;
-	cells = new Cell[size];
-	for (int i = 0; i < size; ++i) cells[i].SetId(i);
+	inverse_width = 1.0 / width;
+	size = (long int)width * height;
 	this->boundary_type = boundary_type;
-	reservoir.SetId(-1-width); //=(width+1)*(height+1)) (an "impossible" id)
+	CreateBands();
+
+	// one additional item at the end for the reservoir
+	directions = this->allocator.Allocate<unsigned char>(size+1);
+	this->allocator.FirstTouch(directions, size+1, bands);
+	directions[size] = RandomDirection();
+	for (long int i = 0; i < size; ++i) {
+		directions[i] = RandomDirection();
+	}
+
+	random_indices = this->allocator.Allocate<long int>(size);
+	this->allocator.FirstTouch(random_indices, size, bands);
+	for (long int i = 0; i < size; ++i) random_indices[i] = i;
+	RandomIndex random_neighbour(context.GetGenerator(FT_NEIGHBOUR));
+	std::random_shuffle(random_indices, random_indices+size, random_neighbour);
+
+	neighbour_offsets = NULL;
+	neighbour_table = NULL;
+	CreateNeighbourTable();
+}
+
+/**
+ * The rows are divided in the same bands as the ones of the toppling threads. In tiles a
+ * band starts at the first row of a tile, so the band is still a range of indices. The
+ * reservoir goes with the last band.
+ */
+void GridBase::CreateBands() {
+	int no_bands = allocator.GetBands();
+	bands.clear();
+	for (int b = 0; b < no_bands; ++b) {
+		int first_row = ((long int)b * height + no_bands - 1) / no_bands;
+		if (layout != GL_ROW_MAJOR) first_row -= first_row % TileSide;
+		bands.push_back((first_row < height) ? GetIndex(0, first_row) : size);
+	}
+	bands.push_back(size+1);
+}
+
+/**
+ * Calculate the neighbours of every cell once, using GetNeighbours(i,j,neighbours). The
+ * order of the neighbours stays the same, so neighbours[Direction] still works for the
+ * boundary types that have four neighbours. In the fully connected case neighbours are
+ * drawn anew on every call, so there is no table.
+ */
+void GridBase::CreateNeighbourTable() {
+	if (boundary_type == BT_FULLY_CONNECTED) return;
+
+	vector<long int> neighbours;
+	neighbour_offsets = allocator.Allocate<long int>(size+1);
+	allocator.FirstTouch(neighbour_offsets, size+1, bands);
+	neighbour_offsets[0] = 0;
+	int i, j;
+	for (long int n = 0; n < size; ++n) {
+		GetCoordinates(n, i, j);
+		GetNeighbours(i, j, neighbours);
+		neighbour_offsets[n+1] = neighbour_offsets[n] + neighbours.size();
+	}
+	neighbour_table = allocator.Allocate<long int>(neighbour_offsets[size]);
+	vector<long int> table_bands;
+	for (unsigned int b = 0; b + 1 < bands.size(); ++b) {
+		table_bands.push_back(neighbour_offsets[bands[b]]);
+	}
+	table_bands.push_back(neighbour_offsets[size]);
+	allocator.FirstTouch(neighbour_table, neighbour_offsets[size], table_bands);
+	for (long int n = 0; n < size; ++n) {
+		GetCoordinates(n, i, j);
+		GetNeighbours(i, j, neighbours);
+		for (unsigned int k = 0; k < neighbours.size(); ++k) {
+			neighbour_table[neighbour_offsets[n]+k] = neighbours[k];
+		}
+	}
+}
 
-	random_indices = new int[size];
-	for (int i = 0; i < size; ++i) random_indices[i] = i;
-	std::random_shuffle(random_indices, random_indices+size, p_boost_random_neigh);
+/**
+ * Only for BT_FULLY_CONNECTED. The neighbours are stored in a scratch array that will be
+ * overwritten on the next call.
+ */
+int GridBase::GetRandomNeighbours(long int n, const long int * & neighbours) {
+	int no_n = 4;
+	int cnt = 0;
+	RandomIndex random_neighbour(context->GetGenerator(FT_NEIGHBOUR));
+	do {
+		long int r = random_neighbour(size);
+		if (r != n) random_neighbours[cnt++] = r;
+	} while (cnt != no_n);
+	neighbours = random_neighbours;
+	return no_n;
 }
 
 /**
- * Remove all the cells and set width and height to zero.
+ * Every new cell gets a random direction. The random generator is the one of the context,
+ * so grids that share a context depend on the order in which they are created.
  */
-Grid::~Grid() {
-	delete [] cells;
-	delete [] random_indices;
-	cells = NULL;
+unsigned char GridBase::RandomDirection() {
+	// here 4 is neighbour size
+	uniform_smallint<size_t> distr(0, 4-1);
+	return distr(context->GetGenerator(FT_DIRECTION));
+}
+
+/**
+ * Remove the directions and the neighbours and set width and height to zero.
+ */
+GridBase::~GridBase() {
+	allocator.Free(directions);
+	allocator.Free(random_indices);
+	allocator.Free(neighbour_offsets);
+	allocator.Free(neighbour_table);
+	neighbour_offsets = neighbour_table = NULL;
+	directions = NULL;
 	width = height = 0;
+	size = 0;
 }
 
 /**
  * Can be used to define a circle within a square grid. Everything outside of the circle
  * can be treated as the reservoir.
  */
-bool Grid::WithinCircle(int i, int j) {
+bool GridBase::WithinCircle(int i, int j) {
 	// only accept even boundary sizes and square grid
 	assert (width == height);
 	assert (width % 2 == 0);
@@ -115,12 +218,12 @@ bool Grid::WithinCircle(int i, int j) {
 }
 
 /**
- * Returns the four neighbours in a rectangular grid. In the periodic case, the
- * boundaries are connected to a "reservoir" cell (might be multiple times). The given
+ * Returns the indices of the four neighbours in a rectangular grid. In the dissipating case,
+ * the boundaries are connected to a "reservoir" cell (might be multiple times). The given
  * vector should already be allocated, naturally, and will be emptied in this function
  * before it is refilled.
  */
-void Grid::GetNeighbours(int i, int j, vector<Cell*> & neighbours) {
+void GridBase::GetNeighbours(int i, int j, vector<long int> & neighbours) {
 	assert (width != 0);
 	assert (height != 0);
 	neighbours.clear();
@@ -136,39 +239,38 @@ void Grid::GetNeighbours(int i, int j, vector<Cell*> & neighbours) {
 				// first we go for the y-coord, then x-coord (xy_toggle = 0)
 				int n_i = (t_i+n*xy_toggle)%width;
 				int n_j = (t_j+n*(1-xy_toggle))%height;
-				Cell *cptr = &cells[n_j*width+n_i];
-				neighbours.push_back(cptr);
+				neighbours.push_back(GetIndex(n_i, n_j));
 			}
 		}
 		assert (neighbours.size() == 4);
 		break;
 	}
 	case BT_DISSIPATING: {
-		if (i == 0) neighbours.push_back(&reservoir);
-		else neighbours.push_back(&cells[j*width+(i-1)]);
+		if (i == 0) neighbours.push_back(size);
+		else neighbours.push_back(GetIndex(i-1, j));
 
-		if (i == width-1) neighbours.push_back(&reservoir);
-		else neighbours.push_back(&cells[j*width+(i+1)]);
+		if (i == width-1) neighbours.push_back(size);
+		else neighbours.push_back(GetIndex(i+1, j));
 
-		if (j == 0) neighbours.push_back(&reservoir);
-		else neighbours.push_back(&cells[(j-1)*width+i]);
+		if (j == 0) neighbours.push_back(size);
+		else neighbours.push_back(GetIndex(i, j-1));
 
-		if (j == height-1) neighbours.push_back(&reservoir);
-		else neighbours.push_back(&cells[(j+1)*width+i]);
+		if (j == height-1) neighbours.push_back(size);
+		else neighbours.push_back(GetIndex(i, j+1));
 
 		assert (neighbours.size() == 4);
 		break;
 	}
 	case BT_WALL_DISSIPATING: {
-		if (i != 0) neighbours.push_back(&cells[j*width+(i-1)]);
+		if (i != 0) neighbours.push_back(GetIndex(i-1, j));
 
-		if (i == width-1) neighbours.push_back(&reservoir);
-		else neighbours.push_back(&cells[j*width+(i+1)]);
+		if (i == width-1) neighbours.push_back(size);
+		else neighbours.push_back(GetIndex(i+1, j));
 
-		if (j != 0) neighbours.push_back(&cells[(j-1)*width+i]);
+		if (j != 0) neighbours.push_back(GetIndex(i, j-1));
 
-		if (j == height-1) neighbours.push_back(&reservoir);
-		else neighbours.push_back(&cells[(j+1)*width+i]);
+		if (j == height-1) neighbours.push_back(size);
+		else neighbours.push_back(GetIndex(i, j+1));
 
 		//		assert (neighbours.size() == 4); // not true anymore!
 		// we can make it true again and be faithful to implementation by introducing
@@ -180,11 +282,10 @@ void Grid::GetNeighbours(int i, int j, vector<Cell*> & neighbours) {
 			for (int xy_toggle = 0; xy_toggle <= 1; ++xy_toggle) {
 				int n_i = (i+n*xy_toggle);
 				int n_j = (j+n*(1-xy_toggle));
-				Cell *cptr = &GetCell(n_i, n_j);
 				if (!WithinCircle(n_i, n_j))
-					neighbours.push_back(&reservoir);
+					neighbours.push_back(size);
 				else
-					neighbours.push_back(cptr);
+					neighbours.push_back(GetIndex(n_i, n_j));
 			}
 		}
 		assert (neighbours.size() == 4);
@@ -198,12 +299,12 @@ void Grid::GetNeighbours(int i, int j, vector<Cell*> & neighbours) {
 	case BT_FULLY_CONNECTED: {
 		unsigned int no_n = 4;
 		unsigned int cnt = 0;
-		int this_i = j * width + i;
+		long int this_i = GetIndex(i, j);
+		RandomIndex random_neighbour(context->GetGenerator(FT_NEIGHBOUR));
 		do {
-			int n = boost_random_neigh(width*height);
+			long int n = random_neighbour(size);
 			if (n != this_i) {
-				Cell *cptr = &GetCell(n);
-				neighbours.push_back(cptr);
+				neighbours.push_back(n);
 				cnt++;
 			}
 		} while (cnt != no_n);
@@ -225,9 +326,8 @@ void Grid::GetNeighbours(int i, int j, vector<Cell*> & neighbours) {
 			for (int xy_toggle = 0; xy_toggle <= 1; ++xy_toggle) {
 				int n_i = (t_i+n*xy_toggle)%width;
 				int n_j = (t_j+n*(1-xy_toggle))%height;
-				int index = random_indices[n_j*width+n_i];
-				Cell *cptr = &GetCell(index);
-				neighbours.push_back(cptr);
+				long int index = random_indices[GetIndex(n_i, n_j)];
+				neighbours.push_back(index);
 			}
 		}
 		assert (neighbours.size() == 4);
@@ -243,39 +343,92 @@ void Grid::GetNeighbours(int i, int j, vector<Cell*> & neighbours) {
 	// neighbours[Direction] should be really in the given direction
 	//#define CHECK_DIRECTIONS
 #ifdef CHECK_DIRECTIONS
-	int id = neighbours[NORTH]->GetId();
-	int n_i = id % width;
-	int n_j = id / width;
+	int id = neighbours[NORTH];
+	int n_i, n_j;
+	GetCoordinates(id, n_i, n_j);
 	int modj_min = (j + height - 1) % height;
 	assert ((i == n_i) && (n_j == modj_min));
 
-	id = neighbours[SOUTH]->GetId();
-	n_i = id % width;
-	n_j = id / width;
+	id = neighbours[SOUTH];
+	GetCoordinates(id, n_i, n_j);
 	int modj_plus = (j + 1) % height;
 	assert ((i == n_i) && (n_j == modj_plus));
 
-	id = neighbours[WEST]->GetId();
-	n_i = id % width;
-	n_j = id / width;
+	id = neighbours[WEST];
+	GetCoordinates(id, n_i, n_j);
 	int modi_min = (i + width - 1) % width;
 	assert ((j == n_j) && (n_i == modi_min) );
 
-	id = neighbours[EAST]->GetId();
-	n_i = id % width;
-	n_j = id / width;
+	id = neighbours[EAST];
+	GetCoordinates(id, n_i, n_j);
 	int modi_plus = (i + 1) % width;
 	assert ((j == n_j) && (n_i == modi_plus) );
 #endif
 }
 
+/* **************************************************************************************
+ * Implementation of Grid
+ * **************************************************************************************/
+
+/**
+ * The heights of all cells start at zero, the capacities at 10. The arrays are touched band
+ * by band first, so the pages are already placed when they are filled here.
+ */
+template <typename T>
+Grid<T>::Grid(int width, int height, BoundaryType boundary_type, SimulationContext & context,
+		GridLayout layout, const GridAllocator & allocator):
+		GridBase(width, height, boundary_type, context, layout, allocator) {
+	altered_function = NULL;
+	histogram = NULL;
+	grains = 0;
+
+	// one additional item at the end for the reservoir
+	heights = this->allocator.template Allocate<T>(size+1);
+	capacities = this->allocator.template Allocate<T>(size+1);
+	this->allocator.FirstTouch(heights, size+1, bands);
+	this->allocator.FirstTouch(capacities, size+1, bands);
+	for (long int i = 0; i <= size; ++i) {
+		heights[i] = 0;
+		capacities[i] = 10;
+	}
+}
+
 /**
- * Counting total grains over all grid cells.
+ * Remove all the cells.
  */
-GrainType Grid::CountGrains() {
+template <typename T>
+Grid<T>::~Grid() {
+	allocator.Free(heights);
+	allocator.Free(capacities);
+	heights = capacities = NULL;
+	delete histogram;
+}
+
+/**
+ * Start keeping a histogram of the heights, counting the cells once, or stop keeping it.
+ * From then on every change in height through the grid, a cell, or the toppling procedure
+ * moves a cell from one bin to another.
+ */
+template <typename T>
+void Grid<T>::SetHistogram(bool keep) {
+	delete histogram;
+	histogram = NULL;
+	if (!keep) return;
+	histogram = new HeightHistogram<T>();
+	for (long int i = 0; i < size; ++i) {
+		histogram->Add(HeightHistogram<T>::Bin(heights[i]), 1);
+	}
+}
+
+/**
+ * Counting total grains over all grid cells. This goes over the whole grid, use GetGrains
+ * for the running total.
+ */
+template <typename T>
+GrainType Grid<T>::CountGrains() {
 	GrainType sum = 0;
-	for (int i = 0; i < width*height; ++i) {
-		sum += cells[i].GetHeight();
+	for (long int i = 0; i < size; ++i) {
+		sum += heights[i];
 	}
 	return sum;
 }
@@ -284,22 +437,39 @@ GrainType Grid::CountGrains() {
  * Returns a cell with the given coordinates. It is now excessively checking
  * on conditions. The first coordinate should not be less then the width, the
  * second should be below the height. This is the same as
- * GetCell(i+j*width).
+ * GetCell(GetIndex(i,j)), which is GetCell(i+j*width) if the cells are stored row by row.
  */
-Cell & Grid::GetCell(int i, int j) {
+template <typename T>
+Cell<T> Grid<T>::GetCell(int i, int j) {
 	assert (j < height);
 	assert (i < width);
-	return cells[j*width+i];
+	return GetCell(GetIndex(i, j));
 }
 
 /**
  * Just give the cell directly and assume the user knows how it is stored internally.
- * Do not mix the x and y coordinates of course. :-) This is the same as
- * GetCell(n % width, n / width).
+ * Do not mix the x and y coordinates of course. :-) Row by row this is the same as
+ * GetCell(n % width, n / width), see GetCoordinates otherwise. The reservoir can be
+ * obtained with GetCell(GetReservoir()).
  */
-Cell & Grid::GetCell(int n) {
-	assert (n < height * width);
-	return cells[n];
+template <typename T>
+Cell<T> Grid<T>::GetCell(int n) {
+	assert (n <= size);
+	// the reservoir (at index size) does not call the observer
+	const AlteredCallback *func = (n == size) ? NULL : &altered_function;
+	GrainType *total = (n == size) ? NULL : &grains;
+	HeightHistogram<T> *bins = (n == size) ? NULL : histogram;
+	return Cell<T>(&heights[n], &directions[n], &capacities[n], n, func, total, bins);
+}
+
+/**
+ * Set the maximum capacity of every cell in the grid to the same value.
+ */
+template <typename T>
+void Grid<T>::SetMaxCapacity(T capacity) {
+	for (long int i = 0; i <= size; ++i) {
+		capacities[i] = capacity;
+	}
 }
 
 /**
@@ -308,7 +478,8 @@ Cell & Grid::GetCell(int n) {
  * table with size width*height. It will become less useful when the grid
  * becomes larger than say 60*60.
  */
-void Grid::Print() {
+template <typename T>
+void Grid<T>::Print() {
 	cout << "Grid size = " << CountGrains() << endl;
 	int p = cout.precision();
 	cout.setf(ios::fixed);
@@ -327,3 +498,11 @@ void Grid::Print() {
 	cout.precision(p);
 }
 
+/* **************************************************************************************
+ * Explicit instantiations of Grid
+ * **************************************************************************************/
+
+template class Grid<uint8_t>;
+template class Grid<int32_t>;
+template class Grid<float>;
+template class Grid<double>;
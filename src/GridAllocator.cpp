@@ -0,0 +1,241 @@
+/**
+ * @file GridAllocator.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+// General files
+#include <GridAllocator.h>
+
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cassert>
+#include <new>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+using namespace std;
+
+std::ostream& operator<<( std::ostream& os, const PageType& type ){
+	switch(type) {
+	case PT_NORMAL: os << "normal pages"; break;
+	case PT_TRANSPARENT_HUGE: os << "transparent huge pages"; break;
+	case PT_EXPLICIT_HUGE: os << "explicit huge pages"; break;
+	}
+	return os;
+}
+
+//! Page size of the system
+static size_t SystemPageSize() {
+	return sysconf(_SC_PAGESIZE);
+}
+
+//! Size of a huge page, from /proc/meminfo, 2 MB if it is not there
+static size_t HugePageSize() {
+	ifstream meminfo("/proc/meminfo");
+	string key;
+	size_t kb;
+	while (meminfo >> key) {
+		if ((key == "Hugepagesize:") && (meminfo >> kb)) return kb << 10;
+	}
+	return 2 << 20;
+}
+
+//! If the kernel hands out transparent huge pages on request, it does not if they are "never"
+static bool TransparentHugePages() {
+	ifstream enabled("/sys/kernel/mm/transparent_hugepage/enabled");
+	string modes;
+	if (!getline(enabled, modes)) return false;
+	return modes.find("[never]") == string::npos;
+}
+
+//! Round up to a multiple of the given power of two
+static size_t RoundUp(size_t bytes, size_t multiple) {
+	return (bytes + multiple - 1) & ~(multiple - 1);
+}
+
+/* **************************************************************************************
+ * Implementation of GridAllocator
+ * **************************************************************************************/
+
+/**
+ * One band means that the arrays are touched by the thread that writes them first, as
+ * with new.
+ */
+GridAllocator::GridAllocator(PageType page_type, int no_bands): page_type(page_type),
+		no_bands(no_bands < 1 ? 1 : no_bands), page_size(SystemPageSize()), largest(0) {
+}
+
+/**
+ * The arrays of the other allocator stay with the other allocator.
+ */
+GridAllocator::GridAllocator(const GridAllocator & other): page_type(other.page_type),
+		no_bands(other.no_bands), page_size(SystemPageSize()), largest(0) {
+}
+
+/**
+ * Unmap what is left, normally the grid frees all its arrays itself.
+ */
+GridAllocator::~GridAllocator() {
+	for (map<void*, size_t>::iterator i = mappings.begin(); i != mappings.end(); ++i) {
+		munmap(i->first, i->second);
+	}
+}
+
+/**
+ * Anonymous mappings are zero. For transparent huge pages the mapping has to start at a
+ * multiple of the huge page size, so one huge page more is mapped and what sticks out at
+ * both ends is unmapped again. If the huge page pool is empty, or transparent huge pages
+ * are disabled, it falls back to the next type of pages with a warning, and stays there.
+ */
+void *GridAllocator::Map(size_t bytes) {
+	size_t normal = SystemPageSize();
+	size_t huge = HugePageSize();
+	size_t used = normal;
+	void *array = MAP_FAILED;
+	size_t length = RoundUp(bytes ? bytes : 1, normal);
+
+	if ((page_type == PT_EXPLICIT_HUGE) && (bytes >= huge)) {
+#ifdef MAP_HUGETLB
+		size_t huge_length = RoundUp(bytes, huge);
+		array = mmap(NULL, huge_length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (array != MAP_FAILED) {
+			length = huge_length;
+			used = huge;
+		}
+#endif
+		if (array == MAP_FAILED) {
+			cerr << "Warning: no explicit huge pages available (see /proc/sys/vm/nr_hugepages), "
+					<< "use transparent huge pages instead" << endl;
+			page_type = PT_TRANSPARENT_HUGE;
+		}
+	}
+
+	if ((array == MAP_FAILED) && (page_type == PT_TRANSPARENT_HUGE) && (bytes >= huge)) {
+#ifdef MADV_HUGEPAGE
+		if (TransparentHugePages()) {
+			size_t huge_length = RoundUp(bytes, huge);
+			char *mapped = (char*)mmap(NULL, huge_length + huge, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapped == MAP_FAILED) throw std::bad_alloc();
+			char *aligned = (char*)RoundUp((size_t)mapped, huge);
+			if (aligned != mapped) munmap(mapped, aligned - mapped);
+			size_t tail = (mapped + huge_length + huge) - (aligned + huge_length);
+			if (tail) munmap(aligned + huge_length, tail);
+			madvise(aligned, huge_length, MADV_HUGEPAGE);
+			array = aligned;
+			length = huge_length;
+			used = huge;
+		}
+#endif
+		if (array == MAP_FAILED) {
+			cerr << "Warning: transparent huge pages are disabled, use normal pages instead"
+					<< endl;
+			page_type = PT_NORMAL;
+		}
+	}
+
+	if (array == MAP_FAILED) {
+		array = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (array == MAP_FAILED) throw std::bad_alloc();
+	}
+
+	mappings[array] = length;
+	if (bytes >= largest) {
+		largest = bytes;
+		page_size = used;
+	}
+	return array;
+}
+
+/**
+ * The length of the mapping is looked up, NULL is ignored like with delete.
+ */
+void GridAllocator::Unmap(void *array) {
+	if (array == NULL) return;
+	map<void*, size_t>::iterator i = mappings.find(array);
+	assert (i != mappings.end());
+	munmap(i->first, i->second);
+	mappings.erase(i);
+}
+
+/**
+ * The CPUs the process may run on are divided in consecutive ranges, one per band. With more
+ * bands than CPUs some bands share a CPU. Nothing is pinned to the range of the first band,
+ * that is left to the calling thread, see Touch.
+ */
+bool GridAllocator::Pin(int band, int no_bands) {
+#ifdef CPU_SET
+	cpu_set_t allowed, cpus;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) return false;
+	vector<int> ids;
+	for (int c = 0; c < CPU_SETSIZE; ++c) {
+		if (CPU_ISSET(c, &allowed)) ids.push_back(c);
+	}
+	if (ids.empty() || (no_bands < 1)) return false;
+	long int first = (long int)band * ids.size() / no_bands;
+	long int last = std::max(first + 1, (long int)(band + 1) * (long int)ids.size() / no_bands);
+	CPU_ZERO(&cpus);
+	for (long int c = first; c < last; ++c) CPU_SET(ids[c], &cpus);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+	return false;
+#endif
+}
+
+//! Write zeros to the given bytes, run by the thread of a band on the CPUs of the band
+static void TouchBand(char *begin, size_t bytes, int band, int no_bands) {
+	GridAllocator::Pin(band, no_bands);
+	memset(begin, 0, bytes);
+}
+
+/**
+ * With one band nothing is done, the pages are placed when they are written first anyway.
+ * Otherwise the calling thread touches the first band itself, just as it topples the first
+ * lane, and the other bands are touched by a thread of their own. The calling thread is not
+ * pinned, threads that it creates later would get its CPUs as well. The bounds are clipped
+ * to the count items of the array. A page on the border between two bands goes to one of
+ * them.
+ */
+void GridAllocator::Touch(char *array, size_t item_size, long int count,
+		const vector<long int> & bounds) {
+	if ((no_bands <= 1) || (bounds.size() < 3)) return;
+	int touched_bands = bounds.size() - 1;
+	boost::thread_group threads;
+	for (int b = 1; b < touched_bands; ++b) {
+		long int begin = std::min(bounds[b], count);
+		long int end = std::min(bounds[b+1], count);
+		if (end <= begin) continue;
+		threads.create_thread(boost::bind(&TouchBand, array + begin * item_size,
+				(end - begin) * item_size, b, touched_bands));
+	}
+	long int end = std::min(bounds[1], count);
+	if (end > bounds[0]) memset(array + bounds[0] * item_size, 0, (end - bounds[0]) * item_size);
+	threads.join_all();
+}
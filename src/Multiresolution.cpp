@@ -251,7 +251,7 @@ bool Multiresolution::GetCoarseCells(int level, std::vector<CoarseCell*> & cells
 //		cout << "Array [cell id=" << n << "]: {";
 		for (int j = 0; j < cs_L; ++j) {
 			for (int i = 0; i < cs_L; ++i) {
-				int index = x*cs_L+i + (y*cs_L+j)*L;
+				int index = grid->GetIndex(x*cs_L+i, y*cs_L+j);
 //				cout << index;
 				GrainType val =  grid->GetCell(index).GetHeight();
 //				if (val) cout << "[" << val << "]";
@@ -0,0 +1,318 @@
+/**
+ * @file PackedLattice.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+// General files
+#include <PackedLattice.h>
+#include <assert.h>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of PackedLattice
+ * **************************************************************************************/
+
+/**
+ * Construct an empty lattice of width*height cells. The rows are padded to a multiple of
+ * 64 cells, the padding never gets any grains.
+ */
+PackedLattice::PackedLattice(int width, int height): width(width), height(height),
+		top(height), bottom(-1), outflow(0) {
+	assert (width > 0 && height > 0);
+	size = (long int)width * height;
+	words = (width + 63) / 64;
+	left = words;
+	right = -1;
+	dense_threshold = words;
+	last_mask = (width % 64) ? ((uint64_t)1 << (width % 64)) - 1 : ~(uint64_t)0;
+	cout << "Create packed cells " << width << "*" << height << " (total=" << size << ")" << endl;
+	planes.resize((long int)height * words * 2, 0);
+	upper.resize(height, (uint64_t*)NULL);
+	above.resize(words, 0);
+	current.resize(words, 0);
+	zeros.resize(words, 0);
+}
+
+PackedLattice::~PackedLattice() {
+	for (int r = 0; r < height; ++r) delete [] upper[r];
+	for (size_t i = 0; i < spare.size(); ++i) delete [] spare[i];
+}
+
+/**
+ * The height of a cell, which is in the overflow table if it is unstable.
+ */
+int PackedLattice::GetValue(long int n) {
+	boost::unordered_map<long int, long int>::iterator it = overflow.find(n);
+	if (it != overflow.end()) return it->second;
+	return GetBits(n);
+}
+
+void PackedLattice::Increase(long int n, int number) {
+	Add(n, number, 4);
+}
+
+/**
+ * A cell that gets 4 grains or more moves from the bit planes to the overflow table. It is
+ * pushed on the stack once it reaches the limit, a cell on the stack only gets more grains
+ * till it is toppled, so it is never on the stack twice.
+ */
+void PackedLattice::Add(long int n, long int number, int limit) {
+	boost::unordered_map<long int, long int>::iterator it = overflow.find(n);
+	long int before, after;
+	if (it != overflow.end()) {
+		before = it->second;
+		after = it->second += number;
+	} else {
+		before = GetBits(n);
+		after = before + number;
+		if (after < 4) {
+			SetBits(n, after);
+			return;
+		}
+		SetBits(n, 0);
+		overflow[n] = after;
+	}
+	if (before < limit && after >= limit) stack.push_back(n);
+}
+
+/**
+ * Topple a cell as many times as needed to get it below the limit at once, the neighbours
+ * get a grain per toppling. With a limit of 4 the cell becomes stable. Neighbours outside of
+ * the grid are counted as outflow.
+ */
+void PackedLattice::ToppleCell(long int n, int limit, long int & avalanche_size) {
+	boost::unordered_map<long int, long int>::iterator it = overflow.find(n);
+	if (it == overflow.end() || it->second < limit) return;
+	long int k = (it->second - limit) / 4 + 1;
+	long int h = it->second - 4 * k;
+	if (h < 4) {
+		overflow.erase(it);
+		SetBits(n, h);
+	} else {
+		it->second = h;
+	}
+	avalanche_size += k;
+
+	long int i = n % width, j = n / width;
+	if (i > 0) Add(n - 1, k, limit); else outflow += k;
+	if (i < width - 1) Add(n + 1, k, limit); else outflow += k;
+	if (j > 0) Add(n - width, k, limit); else outflow += k;
+	if (j < height - 1) Add(n + width, k, limit); else outflow += k;
+}
+
+/**
+ * Relax the lattice. The unstable cells are toppled one by one, till there are more of them
+ * than the dense threshold. Then the rest of the avalanche is done with dense sweeps.
+ */
+void PackedLattice::Relax(long int & avalanche_size) {
+	avalanche_size = 0;
+	while (!stack.empty()) {
+		if ((long int)overflow.size() > dense_threshold) {
+			ToppleDense(avalanche_size);
+			return;
+		}
+		long int n = stack.back();
+		stack.pop_back();
+		ToppleCell(n, 4, avalanche_size);
+	}
+}
+
+/**
+ * The third bit plane holds heights up to 7. Cells with more grains are first toppled one by
+ * one till they have at most 7. A sweep keeps it that way: a cell that topples has at most
+ * 3 grains left, and gets at most 4 grains from its neighbours. The overflow table then moves
+ * to the third bit plane, and the grid is swept till no cell topples anymore.
+ */
+void PackedLattice::ToppleDense(long int & avalanche_size) {
+	stack.clear();
+	for (boost::unordered_map<long int, long int>::iterator it = overflow.begin();
+			it != overflow.end(); ++it) {
+		if (it->second >= 8) stack.push_back(it->first);
+	}
+	while (!stack.empty()) {
+		long int n = stack.back();
+		stack.pop_back();
+		ToppleCell(n, 8, avalanche_size);
+	}
+
+	for (boost::unordered_map<long int, long int>::iterator it = overflow.begin();
+			it != overflow.end(); ++it) {
+		long int n = it->first;
+		int r = n / width;
+		if (upper[r] == NULL) upper[r] = NewPlane();
+		int w = n % width >> 6;
+		upper[r][w] |= (uint64_t)1 << (n % width & 63);
+		SetBits(n, it->second & 3);
+		top = min(top, r);
+		bottom = max(bottom, r);
+		left = min(left, w);
+		right = max(right, w);
+	}
+	overflow.clear();
+
+	long int topplings;
+	do {
+		topplings = Sweep();
+		avalanche_size += topplings;
+	} while (topplings > 0);
+	assert (top == height && bottom == -1 && left == words && right == -1);
+}
+
+/**
+ * One synchronous update of the rows with a third bit plane and the rows next to them, over
+ * the words with a third bit set and the words next to them. The cells that topple are the
+ * ones with the third bit set. Per word the grains from the west, east, north and south are
+ * four masks of one bit per cell, they are added (bitsliced) to the remaining 2-bit heights,
+ * which gives a 3-bit height again. The masks of the row above and of the current row are
+ * copied before they are overwritten, the row below is not updated yet. Words without any
+ * toppling in or next to them stay as they are. A third bit plane that ends up empty is put
+ * aside.
+ */
+long int PackedLattice::Sweep() {
+	long int topplings = 0;
+	int first = max(top - 1, 0), last = min(bottom + 1, height - 1);
+	int begin = max(left - 1, 0), end = min(right + 1, words - 1);
+	int new_top = height, new_bottom = -1, new_left = words, new_right = -1;
+	bool above_any = false;
+	bool current_any = (upper[first] != NULL);
+	if (current_any) copy(upper[first] + begin, upper[first] + end + 1, current.begin() + begin);
+	for (int r = first; r <= last; ++r) {
+		bool below_any = (r + 1 < height) && (upper[r+1] != NULL);
+		if (above_any || current_any || below_any) {
+			const uint64_t *north = above_any ? &above[0] : &zeros[0];
+			const uint64_t *self = current_any ? &current[0] : &zeros[0];
+			const uint64_t *south = below_any ? upper[r+1] : &zeros[0];
+			if (upper[r] == NULL) upper[r] = NewPlane();
+			uint64_t *high = upper[r];
+			uint64_t *low = &planes[(long int)r * words * 2];
+			long int row_topplings = 0;
+			bool any = false;
+			for (int w = begin; w <= end; ++w) {
+				uint64_t t = self[w];
+				uint64_t a = (t << 1) | (w > begin ? self[w-1] >> 63 : 0);
+				uint64_t b = (t >> 1) | (w < end ? self[w+1] << 63 : 0);
+				uint64_t c = north[w], d = south[w];
+				if (w + 1 == words) a &= last_mask;
+				if ((t | a | b | c | d) == 0) continue;
+
+				// number of grains received, 0 to 4 in three bits
+				uint64_t x1 = a ^ b, c1 = a & b, x2 = c ^ d, c2 = c & d;
+				uint64_t s0 = x1 ^ x2, c3 = x1 & x2;
+				uint64_t s1 = c1 ^ c2 ^ c3, s2 = (c1 & c2) | (c1 & c3) | (c2 & c3);
+
+				// added to the height without the third bit (minus 4 for the toppled cells)
+				uint64_t l0 = low[2*w], l1 = low[2*w+1];
+				uint64_t k0 = l0 & s0;
+				low[2*w] = l0 ^ s0;
+				low[2*w+1] = l1 ^ s1 ^ k0;
+				high[w] = s2 ^ ((l1 & s1) | (k0 & (l1 ^ s1)));
+				if (high[w]) {
+					any = true;
+					new_left = min(new_left, w);
+					new_right = max(new_right, w);
+				}
+				row_topplings += __builtin_popcountll(t);
+			}
+			if (current_any) {
+				if (begin == 0) outflow += self[0] & 1;
+				if (end == words - 1) outflow += (self[end] >> ((width - 1) & 63)) & 1;
+				if (r == 0) outflow += row_topplings;
+				if (r == height - 1) outflow += row_topplings;
+			}
+			topplings += row_topplings;
+			if (any) {
+				new_top = min(new_top, r);
+				new_bottom = max(new_bottom, r);
+			} else {
+				spare.push_back(upper[r]);
+				upper[r] = NULL;
+			}
+		}
+		above.swap(current);
+		above_any = current_any;
+		current_any = below_any;
+		if (below_any) copy(upper[r+1] + begin, upper[r+1] + end + 1, current.begin() + begin);
+	}
+	top = new_top;
+	bottom = new_bottom;
+	left = new_left;
+	right = new_right;
+	return topplings;
+}
+
+/**
+ * An empty third bit plane for a row, the ones that are not in use anymore are kept aside so
+ * a sweep does not allocate memory for every row it reaches. They are all zero again when
+ * they are put aside.
+ */
+uint64_t *PackedLattice::NewPlane() {
+	if (spare.empty()) return new uint64_t[words]();
+	uint64_t *plane = spare.back();
+	spare.pop_back();
+	return plane;
+}
+
+/**
+ * With the heights of a word in two bit planes the grains are counted with popcount. Only
+ * stable cells are in the bit planes (the overflow table is empty after Relax).
+ */
+GrainType PackedLattice::CountGrains() {
+	GrainType total = 0;
+	for (size_t w = 0; w < planes.size(); w += 2) {
+		total += __builtin_popcountll(planes[w]) + 2 * __builtin_popcountll(planes[w+1]);
+	}
+	for (boost::unordered_map<long int, long int>::iterator it = overflow.begin();
+			it != overflow.end(); ++it) {
+		total += it->second;
+	}
+	return total;
+}
+
+void PackedLattice::CountHeights(long int *counts) {
+	long int counted[4] = {0, 0, 0, 0};
+	for (size_t w = 0; w < planes.size(); w += 2) {
+		uint64_t l0 = planes[w], l1 = planes[w+1];
+		counted[1] += __builtin_popcountll(l0 & ~l1);
+		counted[2] += __builtin_popcountll(~l0 & l1);
+		counted[3] += __builtin_popcountll(l0 & l1);
+	}
+	counted[0] = size - counted[1] - counted[2] - counted[3] - overflow.size();
+	for (int h = 0; h < 4; ++h) counts[h] += counted[h];
+}
+
+void PackedLattice::Clear() {
+	fill(planes.begin(), planes.end(), 0);
+	overflow.clear();
+	stack.clear();
+	outflow = 0;
+}
+
+void PackedLattice::Print() {
+	for (int j = 0; j < height; ++j) {
+		for (int i = 0; i < width; ++i) {
+			cout << GetValue((long int)j * width + i) << ' ';
+		}
+		cout << endl;
+	}
+}
@@ -109,6 +109,18 @@ void Persist::LoadIni() {
 	file.add_options() (
 			"L", value<int>(), "system size")
 			("toppling_method", value<int>(), "toppling method")
+			("height_type", value<int>(), "type of the heights (0=double, 1=float, 2=int32, 3=uint8)")
+			("no_threads", value<int>(), "number of threads that topple an avalanche")
+			("tiled", value<bool>(), "decompose the grid in a tile per thread")
+			("no_trial_threads", value<int>(), "number of trials that run at the same time")
+			("avalanche_log", value<bool>(), "write every avalanche to a binary log")
+			("checkpoint_interval", value<long int>(), "ticks between checkpoints (0 is none)")
+			("state_cache", value<std::string>(), "directory with sandpiles after the skipped ticks")
+			("auto_skip", value<bool>(), "skip ticks till the grains per cell are stationary")
+			("synchronous", value<bool>(), "topple all unstable cells at the same time (BTW only)")
+			("grid_layout", value<int>(), "order of the cells in memory (0=row by row, 1=tiles of 64x64)")
+			("page_type", value<int>(), "pages of the grids (0=normal, 1=transparent huge, 2=explicit huge)")
+			("first_touch", value<bool>(), "first touch the rows of each toppling thread on its CPUs")
 			("timespan", value<long int>(), "time span")
 			("no_trials", value<int>(), "number of trials")
 			("skip", value<int>(), "skip counting/visualising for first ticks")
@@ -132,6 +144,55 @@ void Persist::LoadIni() {
 		config.toppling_method = tm;
 	}
 
+	if (vm.count("height_type")) {
+		HeightType ht = (HeightType)vm["height_type"].as<int>();
+		config.height_type = ht;
+	}
+
+	if (vm.count("no_threads")) {
+		config.no_threads = vm["no_threads"].as<int>();
+	}
+
+	if (vm.count("tiled")) {
+		config.tiled = vm["tiled"].as<bool>();
+	}
+
+	if (vm.count("no_trial_threads")) {
+		config.no_trial_threads = vm["no_trial_threads"].as<int>();
+	}
+
+	if (vm.count("avalanche_log")) {
+		config.avalanche_log = vm["avalanche_log"].as<bool>();
+	}
+
+	if (vm.count("checkpoint_interval")) {
+		config.checkpoint_interval = vm["checkpoint_interval"].as<long int>();
+	}
+
+	if (vm.count("state_cache")) {
+		config.state_cache = vm["state_cache"].as<std::string>();
+	}
+
+	if (vm.count("auto_skip")) {
+		config.auto_skip = vm["auto_skip"].as<bool>();
+	}
+
+	if (vm.count("synchronous")) {
+		config.synchronous = vm["synchronous"].as<bool>();
+	}
+
+	if (vm.count("grid_layout")) {
+		config.grid_layout = (GridLayout)vm["grid_layout"].as<int>();
+	}
+
+	if (vm.count("page_type")) {
+		config.page_type = (PageType)vm["page_type"].as<int>();
+	}
+
+	if (vm.count("first_touch")) {
+		config.first_touch = vm["first_touch"].as<bool>();
+	}
+
 }
 
 /**
@@ -147,6 +208,18 @@ void Persist::StoreDefaults() {
 	config.no_trials = 1;
 	config.toppling_method = Lin_etal2006;
 	config.boundary_type = BT_UNDEFINED;
+	config.height_type = HT_DOUBLE;
+	config.no_threads = 1;
+	config.tiled = false;
+	config.no_trial_threads = 1;
+	config.avalanche_log = false;
+	config.checkpoint_interval = 0;
+	config.state_cache = "";
+	config.auto_skip = false;
+	config.synchronous = false;
+	config.grid_layout = GL_ROW_MAJOR;
+	config.page_type = PT_NORMAL;
+	config.first_touch = false;
 	config.toppling_threshold = -1;
 	config.dissipative_mode = true;
 	config.dissipation_rate = 0.1;
@@ -228,6 +301,19 @@ void Persist::StoreDefaults() {
 	fc.output_type = PL_GRAPH;
 	config.figures.insert(std::make_pair<PlotFigureType,FigureConfig>(pft,fc));
 
+	pft = PFT_AvalancheArea;
+	fc.filename = "avalanche_area";
+	t.clear(); t.str("");
+	t << "Avalanche area, model=" << config.toppling_method <<
+			" (L=" << config.system_size << ")" << " (T=" << config.timespan << ")";
+	fc.title = t.str();
+	fc.x_axis = "Avalanche area (A)";
+	fc.y_axis = "P(A)";
+	fc.plot_mode = PM_LOGLOG;
+	fc.plot_type = PT_DEFAULT;
+	fc.output_type = PL_GRAPH;
+	config.figures.insert(std::make_pair<PlotFigureType,FigureConfig>(pft,fc));
+
 	pft = PFT_Height;
 	fc.filename = "height";
 	fc.title = "Height distribution over the grid";
@@ -259,6 +345,56 @@ void Persist::StoreDefaults() {
 	oa << config;
 }
 
+/**
+ * The duration of an avalanche is counted in waves, so the faster relaxation procedures are
+ * not used if it is plotted, and the radius and the bounding box slow the waves down, see
+ * Experiment::CreateSandPile. That is why these figures are not in the defaults.
+ */
+void AddShapeFigures(Config & config) {
+	FigureConfig fc;
+	PlotFigureType pft;
+	ostringstream t;
+
+	pft = PFT_AvalancheDuration;
+	fc.filename = "avalanche_duration";
+	t.clear(); t.str("");
+	t << "Avalanche duration, model=" << config.toppling_method <<
+			" (L=" << config.system_size << ")" << " (T=" << config.timespan << ")";
+	fc.title = t.str();
+	fc.x_axis = "Avalanche duration in waves (T)";
+	fc.y_axis = "P(T)";
+	fc.plot_mode = PM_LOGLOG;
+	fc.plot_type = PT_DEFAULT;
+	fc.output_type = PL_GRAPH;
+	config.figures.insert(std::make_pair<PlotFigureType,FigureConfig>(pft,fc));
+
+	pft = PFT_AvalancheRadius;
+	fc.filename = "avalanche_radius";
+	t.clear(); t.str("");
+	t << "Avalanche radius, model=" << config.toppling_method <<
+			" (L=" << config.system_size << ")" << " (T=" << config.timespan << ")";
+	fc.title = t.str();
+	fc.x_axis = "Radius of gyration (R)";
+	fc.y_axis = "P(R)";
+	fc.plot_mode = PM_LOGLOG;
+	fc.plot_type = PT_DEFAULT;
+	fc.output_type = PL_GRAPH;
+	config.figures.insert(std::make_pair<PlotFigureType,FigureConfig>(pft,fc));
+
+	pft = PFT_AvalancheExtent;
+	fc.filename = "avalanche_extent";
+	t.clear(); t.str("");
+	t << "Avalanche extent, model=" << config.toppling_method <<
+			" (L=" << config.system_size << ")" << " (T=" << config.timespan << ")";
+	fc.title = t.str();
+	fc.x_axis = "Largest side of the bounding box (X)";
+	fc.y_axis = "P(X)";
+	fc.plot_mode = PM_LOGLOG;
+	fc.plot_type = PT_DEFAULT;
+	fc.output_type = PL_GRAPH;
+	config.figures.insert(std::make_pair<PlotFigureType,FigureConfig>(pft,fc));
+}
+
 /**
  * Load default configuration values. Returns false if we do not succeed in
  * opening the configuration file.
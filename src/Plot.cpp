@@ -273,9 +273,9 @@ void Plot::GetData(DataContainer &cont, PLData & pld) {
 	case PT_DEFAULT:
 		//		cout << "Plot values" << endl;
 		for (int i = 0; i < pld.len; ++i) {
-			pair<DataDecoratorType,int> item = cont.item< pair<DataDecoratorType,int> >(i);
+			pair<DataDecoratorType,double> item = cont.item< pair<DataDecoratorType,double> >(i);
 			DataDecoratorType x = item.first;
-			int y = item.second;
+			double y = item.second;
 			pld.x_axis[i] = Scale(x, true);
 			pld.y_axis[i] = Scale(y, false);
 		}
@@ -283,10 +283,10 @@ void Plot::GetData(DataContainer &cont, PLData & pld) {
 	case PT_DENSITY:
 	case PT_CUMULATIVE_DENSITY:
 		// Total number of samples
-		long int N = 0;
+		double N = 0;
 		for (int i = 0; i < pld.len; ++i) {
-			pair<DataDecoratorType,int> item = cont.item< pair<DataDecoratorType,int> >(i);
-			int y = item.second;
+			pair<DataDecoratorType,double> item = cont.item< pair<DataDecoratorType,double> >(i);
+			double y = item.second;
 			N += y;
 		}
 #ifdef VERBOSE
@@ -296,12 +296,12 @@ void Plot::GetData(DataContainer &cont, PLData & pld) {
 
 		// calculate cumulative density function
 		bool reverse_cdf = false;
-		long int sum = 0;
+		double sum = 0;
 		for (int i = 0; i < pld.len; ++i) {
 			int index = (reverse_cdf ? pld.len - 1 - i : i);
-			pair<DataDecoratorType,int> item = cont.item< pair<DataDecoratorType,int> >(index);
+			pair<DataDecoratorType,double> item = cont.item< pair<DataDecoratorType,double> >(index);
 			DataDecoratorType x = item.first;
-			int y = item.second;
+			double y = item.second;
 			if (plot_type == PT_DENSITY) {
 				PLFLT delta = 1;
 				pld.x_axis[index] = Scale(x, true);
@@ -99,6 +99,22 @@ void PlotFigure::Draw(vector<DataForPlot> &data, Config &config, PlotFigureType
 			i = config.figures.find(PFT_CriticalCells);
 			ap.GetData(cnt).SetData(*d_i->events);
 			break;
+		case PFT_AvalancheArea:
+			i = config.figures.find(PFT_AvalancheArea);
+			ap.GetData(cnt).SetData(*d_i->events);
+			break;
+		case PFT_AvalancheDuration:
+			i = config.figures.find(PFT_AvalancheDuration);
+			ap.GetData(cnt).SetData(*d_i->events);
+			break;
+		case PFT_AvalancheRadius:
+			i = config.figures.find(PFT_AvalancheRadius);
+			ap.GetData(cnt).SetData(*d_i->events);
+			break;
+		case PFT_AvalancheExtent:
+			i = config.figures.find(PFT_AvalancheExtent);
+			ap.GetData(cnt).SetData(*d_i->events);
+			break;
 		case PFT_Height:
 			i = config.figures.find(PFT_Height);
 			append = boost::lexical_cast<std::string>(d_i->time_id);
@@ -157,7 +173,7 @@ void PlotFigure::DrawAgain(Config &config) {
 		int data_id = 0;
 
 		Plot ap;
-		std::map<DataDecoratorType,int> * datamap = new std::map<DataDecoratorType,int>();
+		std::map<DataDecoratorType,double> * datamap = new std::map<DataDecoratorType,double>();
 		ap.SetPath(dirname);
 		DataContainer &data = ap.GetData(data_id);
 		data.SetData(*datamap);
@@ -202,7 +218,7 @@ void PlotFigure::DrawAll(Config &config) {
 
 		cout << "Draw " << i->second.GetDescription() << endl;
 
-		std::vector < std::map<DataDecoratorType,int> * > maps;
+		std::vector < std::map<DataDecoratorType,double> * > maps;
 		std::vector < DataForPlot> dps;
 
 		for (int r = 0; r < config.run_id+1; ++r) {
@@ -217,7 +233,7 @@ void PlotFigure::DrawAll(Config &config) {
 			}
 
 			Plot ap;
-			std::map<DataDecoratorType,int> * datamap = new std::map<DataDecoratorType,int>();
+			std::map<DataDecoratorType,double> * datamap = new std::map<DataDecoratorType,double>();
 			maps.push_back(datamap);
 			ap.SetPath(dirname);
 			DataContainer &data = ap.GetData(r);
@@ -248,7 +264,7 @@ void PlotFigure::DrawAll(Config &config) {
 
 		Draw(dps, config, i->first);
 
-		std::vector < std::map<DataDecoratorType,int> * >::iterator m_i;
+		std::vector < std::map<DataDecoratorType,double> * >::iterator m_i;
 		for (m_i = maps.begin(); m_i != maps.end(); ++m_i) {
 			delete *m_i;
 		}
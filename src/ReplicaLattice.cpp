@@ -0,0 +1,179 @@
+/**
+ * @file ReplicaLattice.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+// General files
+#include <ReplicaLattice.h>
+#include <assert.h>
+#include <iostream>
+#include <string.h>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of ReplicaLattice
+ * **************************************************************************************/
+
+/**
+ * Create an empty lattice for 64 replicas. The undefined boundary is the default one of BTW,
+ * with walls, just as in SandPileBase.
+ */
+ReplicaLattice::ReplicaLattice(int L, BoundaryType boundary_type, const std::vector<int> & feeds,
+		int first_stream): L(L) {
+	if (boundary_type == BT_UNDEFINED) boundary_type = BT_WALL_DISSIPATING;
+	assert (Supports(Bak_Tang_Wiesenfeld1987, boundary_type));
+	this->boundary_type = boundary_type;
+	size = (long int)L * L;
+	cout << "Create " << Replicas << " replicas of " << L << "*" << L << " cells and type "
+			<< boundary_type << endl;
+	for (int k = 0; k < 3; ++k) bits[k].resize(size, 0);
+	visited.resize(size, 0);
+	memset(size_counter, 0, sizeof(size_counter));
+	memset(area_counter, 0, sizeof(area_counter));
+	for (int b = 0; b < Replicas; ++b) {
+		contexts.push_back(new SimulationContext(feeds, first_stream + b));
+		sizes[b] = areas[b] = 0;
+		drive_sites[b] = 0;
+	}
+	avalanches.resize(Replicas);
+	area_counters.resize(Replicas);
+}
+
+ReplicaLattice::~ReplicaLattice() {
+	for (int b = 0; b < Replicas; ++b) delete contexts[b];
+}
+
+/**
+ * The replicas are deterministic BTW sandpiles with one grain per neighbour on toppling.
+ */
+bool ReplicaLattice::Supports(TopplingMethod toppling_method, BoundaryType boundary_type) {
+	if (toppling_method != Bak_Tang_Wiesenfeld1987) return false;
+	return (boundary_type == BT_UNDEFINED) || (boundary_type == BT_DISSIPATING) ||
+			(boundary_type == BT_WALL_DISSIPATING);
+}
+
+/**
+ * The grains are dropped at the same spots as in SandPile::Drive, from the drive sequence of
+ * each replica. With walls, the grains only fall along the walls.
+ */
+void ReplicaLattice::Drive() {
+	for (int b = 0; b < Replicas; ++b) {
+		CounterRandom & random = contexts[b]->GetCounterRandom(FT_DRIVE);
+		int x = CounterRandom::Below(random.Next(), L);
+		int y = CounterRandom::Below(random.Next(), L);
+		long int index = (long int)y * L + x;
+		if (boundary_type == BT_WALL_DISSIPATING) index = (y < L / 2) ? x : (long int)x * L;
+		Increase(b, index);
+		drive_sites[b] = index;
+	}
+}
+
+/**
+ * A stable cell has at most 3 grains, so after one grain the height still fits in three
+ * bits.
+ */
+void ReplicaLattice::Increase(int replica, long int n) {
+	Add(n, (uint64_t)1 << replica);
+}
+
+/**
+ * Sweep till no replica has an unstable cell anymore. The avalanches of all replicas are
+ * relaxed at the same time, each avalanche is as large as if it was relaxed alone.
+ */
+void ReplicaLattice::Relax(bool measure) {
+	while (Sweep()) { }
+
+	for (int b = 0; b < Replicas; ++b) {
+		sizes[b] = Value(size_counter, b);
+		areas[b] = Value(area_counter, b);
+		if (measure && (sizes[b] > 0)) {
+			avalanches[b].AddEvent(sizes[b]);
+			area_counters[b].AddEvent(areas[b]);
+		}
+	}
+	memset(size_counter, 0, sizeof(size_counter));
+	memset(area_counter, 0, sizeof(area_counter));
+	for (size_t k = 0; k < touched.size(); ++k) visited[touched[k]] = 0;
+	touched.clear();
+}
+
+/**
+ * A sweep has two passes. The first takes the replicas with 4 grains or more out of the
+ * unstable cells: the third bit is cleared, which leaves height minus 4. The topplings and
+ * the cells that toppled for the first time are counted per replica. The second pass adds
+ * the masks of the toppled cells to their neighbours, which can make them unstable for the
+ * next sweep. At a wall the grain that would go over it is added to the cell itself.
+ */
+bool ReplicaLattice::Sweep() {
+	if (unstable.empty()) return false;
+	toppled.swap(unstable);
+	unstable.clear();
+	masks.resize(toppled.size());
+	for (size_t k = 0; k < toppled.size(); ++k) {
+		long int n = toppled[k];
+		uint64_t t = bits[2][n];
+		bits[2][n] = 0;
+		masks[k] = t;
+		Count(size_counter, t);
+		Count(area_counter, t & ~visited[n]);
+		if (!visited[n]) touched.push_back(n);
+		visited[n] |= t;
+	}
+
+	bool walls = (boundary_type == BT_WALL_DISSIPATING);
+	for (size_t k = 0; k < toppled.size(); ++k) {
+		long int n = toppled[k];
+		uint64_t t = masks[k];
+		long int i = n % L, j = n / L;
+		if (i > 0) Add(n - 1, t); else if (walls) Add(n, t);
+		if (i < L - 1) Add(n + 1, t);
+		if (j > 0) Add(n - L, t); else if (walls) Add(n, t);
+		if (j < L - 1) Add(n + L, t);
+	}
+	return true;
+}
+
+long int ReplicaLattice::Value(const uint64_t *counter, int replica) {
+	long int value = 0;
+	for (int k = 0; k < 64; ++k) value |= (long int)((counter[k] >> replica) & 1) << k;
+	return value;
+}
+
+int ReplicaLattice::GetValue(int replica, long int n) {
+	int value = 0;
+	for (int k = 0; k < 3; ++k) value |= (int)((bits[k][n] >> replica) & 1) << k;
+	return value;
+}
+
+GrainType ReplicaLattice::CountGrains(int replica) {
+	GrainType total = 0;
+	for (long int n = 0; n < size; ++n) total += GetValue(replica, n);
+	return total;
+}
+
+/**
+ * The counters and the random sequences are not reset, just as with SandPile::Clear.
+ */
+void ReplicaLattice::Clear() {
+	for (int k = 0; k < 3; ++k) fill(bits[k].begin(), bits[k].end(), 0);
+	unstable.clear();
+}
@@ -24,26 +24,26 @@
 // General files
 #include <SandPile.h>
 
-#include <boost/random/uniform_int.hpp>
-#include <boost/bind.hpp>
 #include <boost/random/uniform_01.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
 
 using namespace std;
 using namespace boost;
 
 /* **************************************************************************************
- * Implementation of SandPile
+ * Implementation of SandPileBase
  * **************************************************************************************/
 
-int SandPile::diss_feed = 1233480;
-
-int SandPile::drive_feed = 233480;
-
 /**
- * System size is denoted by L in statistical physics literature. The constructor creates one or
- * two grids depending on the toppling method. In case of the latter DissipationGrid() is called.
+ * System size is denoted by L in statistical physics literature. Every toppling method has
+ * its own default boundary type, which can be overwritten. The layout of the grids does not
+ * change the dynamics, only where the cells are in memory, and neither do the pages of the
+ * allocator.
  */
-SandPile::SandPile(int L, TopplingMethod toppling_method, BoundaryType type) {
+SandPileBase::SandPileBase(SimulationContext & context, int L, TopplingMethod toppling_method,
+		BoundaryType type, GridLayout layout, const GridAllocator & allocator): layout(layout),
+		allocator(allocator), drive_site(0), context(&context) {
 	this->L = L;
 
 	switch (toppling_method) {
@@ -71,7 +71,53 @@ SandPile::SandPile(int L, TopplingMethod toppling_method, BoundaryType type) {
 	} else {
 		cout << "Standard boundary type \"" << type << "\"" << endl;
 	}
+}
+
+/**
+ * Default destructor
+ */
+SandPileBase::~SandPileBase() { }
+
+/**
+ * The type of the heights is only known at runtime, in the configuration. For every type
+ * there is an instantiation of SandPile. In Manna_Lin2010 a cell topples at 2 grains, but
+ * loses 4, so heights become negative and an unsigned type cannot be used.
+ */
+SandPileBase *SandPileBase::Create(SimulationContext & context, HeightType height_type, int L,
+		TopplingMethod toppling_method, BoundaryType type, GridLayout layout,
+		const GridAllocator & allocator) {
+	if ((height_type == HT_UINT8) && (toppling_method == Manna_Lin2010)) {
+		cerr << "Warning, heights can become negative in " << toppling_method <<
+				", use " << HT_INT32 << " instead of " << height_type << endl;
+		height_type = HT_INT32;
+	}
+	switch (height_type) {
+	case HT_UINT8:
+		return new SandPile<uint8_t>(context, L, toppling_method, type, layout, allocator);
+	case HT_INT32:
+		return new SandPile<int32_t>(context, L, toppling_method, type, layout, allocator);
+	case HT_FLOAT:
+		return new SandPile<float>(context, L, toppling_method, type, layout, allocator);
+	case HT_DOUBLE:
+		return new SandPile<double>(context, L, toppling_method, type, layout, allocator);
+	}
+	cerr << "Unknown height type " << (int)height_type << endl;
+	assert (false);
+	return NULL;
+}
+
+/* **************************************************************************************
+ * Implementation of SandPile
+ * **************************************************************************************/
 
+/**
+ * The constructor creates one or two grids depending on the toppling method. In case of
+ * the latter DissipationGrid() is called.
+ */
+template <typename T>
+SandPile<T>::SandPile(SimulationContext & context, int L, TopplingMethod toppling_method,
+		BoundaryType type, GridLayout layout, const GridAllocator & allocator):
+		SandPileBase(context, L, toppling_method, type, layout, allocator) {
 	// For testing the dissipation grid on itself (without sandpile)
 	if (toppling_method == Rossum2011_diss) {
 		toppling = NULL;
@@ -81,18 +127,12 @@ SandPile::SandPile(int L, TopplingMethod toppling_method, BoundaryType type) {
 	}
 
 	// Create sand grid
-	grid = new Grid(L, L, boundary_type);
-	toppling = new Toppling(grid);
+	grid = new Grid<T>(L, L, boundary_type, context, layout, allocator);
+	toppling = new Toppling<T>(grid);
 	toppling->SetTopplingMethod(toppling_method);
 	toppling->SetTopplingIterator(FOLLOW_ACTIVITY);
 	toppling->SetCounterDuringAvalanches(false);
 
-	// Set callback function for every cell in the grid
-	for (int i = 0; i < L*L; ++i) {
-		AlteredCallback callback (boost::bind(&Toppling::CheckCell, toppling, _1));
-		grid->GetCell(i).SetAlteredFunction(callback);
-	}
-
 	diss_grid = NULL;
 	diss_toppling = NULL;
 	if (toppling_method == Rossum2011) {
@@ -104,17 +144,19 @@ SandPile::SandPile(int L, TopplingMethod toppling_method, BoundaryType type) {
  * Only called when there is actually a dissipation grid needed. It creates a separate
  * grid and a distinct toppling object.
  */
-void SandPile::DissipationGrid(TopplingMethod method, int width, int height) {
+template <typename T>
+void SandPile<T>::DissipationGrid(TopplingMethod method, int width, int height) {
 	// We only know one toppling method for dissipation
 	assert (method = Rossum2011_diss);
 
 	// Create dissipation grid
-	diss_grid = new Grid(width, height, BT_PERIODIC);
+	// same layout, the toppling procedure looks up a cell by its index in both grids
+	diss_grid = new Grid<T>(width, height, BT_PERIODIC, *context, layout, allocator);
 	if (toppling != NULL)
 		toppling->SetDissGrid(*diss_grid);
 
 	// Fill cells in dissipation grid with
-	diss_toppling = new Toppling(diss_grid);
+	diss_toppling = new Toppling<T>(diss_grid);
 	diss_toppling->SetTopplingMethod(method);
 	diss_toppling->SetTopplingIterator(RANDOM_ALL);
 	diss_toppling->SetCounterDuringAvalanches(false);
@@ -144,20 +186,21 @@ void SandPile::DissipationGrid(TopplingMethod method, int width, int height) {
  * grid.
  * There should be L spots with max_particles, so no. of particles scales with system size
  */
-void SandPile::Populate(int no_cells, GrainType no_particles) {
+template <typename T>
+void SandPile<T>::Populate(int no_cells, GrainType no_particles) {
 	if (!diss_grid) {
 		cerr << "Do not populate if there is no dissipation grid defined" << endl;
 		return;
 	}
 
-	static boost::mt19937 randomGenerator(diss_feed);
+	boost::mt19937 & randomGenerator = context->GetGenerator(FT_DISSIPATION);
+	boost::uniform_01<double> zeroone;
 	assert (no_cells < L*L);
 	double place = no_cells/(double)(L*L);
 	cout << "Place if zerone() < " << place << endl;
 	long int sum = 0;
 	for (int i = 0; i < L*L; ++i) {
-		static boost::uniform_01<boost::mt19937> zeroone(randomGenerator);
-		bool dissipate = (zeroone() < place);
+		bool dissipate = (zeroone(randomGenerator) < place);
 		if (dissipate) {
 			diss_grid->GetCell(i).Increase(no_particles);
 			sum += no_particles;
@@ -172,63 +215,72 @@ void SandPile::Populate(int no_cells, GrainType no_particles) {
 /**
  * Destroy what is created before...
  */
-SandPile::~SandPile() {
+template <typename T>
+SandPile<T>::~SandPile() {
 	if (grid != NULL) delete grid;
 	if (diss_grid != NULL) delete diss_grid;
 	if (toppling != NULL) delete toppling;
 }
 
 /**
- * Clean the sand
+ * Clean the sand, the toppling procedure is told that the cells changed.
  */
-void SandPile::Clear() {
+template <typename T>
+void SandPile<T>::Clear() {
 	for (int i = 0; i < L*L; ++i) {
 		grid->GetCell(i).Clear();
+		toppling->CheckCell(i);
 	}
 }
 
 /**
  * Adds one "grain" to a random position on the sand_grid. In case of circular boundary
  * it is important not to drop it somewhere else... We only return when we successfully
- * dropped a grain in the designated area.
+ * dropped a grain in the designated area. The cell is activated by the toppling procedure
+ * directly, so the next call to Relax starts from there. The spots come from the sequence
+ * of the counter-based generator, which is made in bulk.
  */
-void SandPile::Drive() {
-	static boost::mt19937 randomGenerator(drive_feed);
+template <typename T>
+void SandPile<T>::Drive() {
+	CounterRandom & random = context->GetCounterRandom(FT_DRIVE);
 	assert (grid != NULL);
 
-	uniform_int<size_t> dist_x(0, grid->GetWidth()-1);
-	uniform_int<size_t> dist_y(0, grid->GetHeight()-1);
-
 	bool success = false;
+	int width = grid->GetWidth();
+	int x, y;
 
 	do {
-		int x = dist_x(randomGenerator);
-		int y = dist_y(randomGenerator);
+		x = CounterRandom::Below(random.Next(), width);
+		y = CounterRandom::Below(random.Next(), grid->GetHeight());
 		if (boundary_type == BT_CIRCULAR) {
 			// only within the circle
-			if (grid->WithinCircle(x, y)) {
-				success = true;
-				grid->GetCell(x,y).Increase(1);
-			}
+			success = grid->WithinCircle(x, y);
 		} else if (boundary_type == BT_WALL_DISSIPATING) {
 			// only at the wall... but doesn't seem to matter
-			if (y < grid->GetHeight() / 2)
-				grid->GetCell(x,0).Increase(1);
-			else
-				grid->GetCell(0,x).Increase(1);
+			if (y < grid->GetHeight() / 2) {
+				y = 0;
+			} else {
+				y = x;
+				x = 0;
+			}
 			success = true;
 		} else {
 			// totally random spot
-			grid->GetCell(x,y).Increase(1);
 			success = true;
 		}
 	} while (!success);
+
+	long int index = grid->GetIndex(x, y);
+	grid->Increase(index, 1);
+	toppling->CheckCell(index);
+	drive_site = (long int)y * width + x;
 }
 
 /**
  * The relaxation process "calculates" all the avalanches till all activity ceases.
  */
-int SandPile::Relax(bool measure) {
+template <typename T>
+int SandPile<T>::Relax(bool measure) {
 	long int avalanche_size = 0;
 
 	// Dissemination in dissipation grid
@@ -247,34 +299,98 @@ int SandPile::Relax(bool measure) {
 	return 0;
 }
 
+/**
+ * The shape is that of the avalanche on the grain grid. Its size is the one that is returned,
+ * so it is 0 as well if the avalanche is not measured. Without a grain grid (Rossum2011_diss)
+ * it is the shape of the avalanche on the dissipation grid.
+ */
+template <typename T>
+int SandPile<T>::Relax(AvalancheShape & shape, bool measure) {
+	int avalanche_size = Relax(measure);
+	shape = (toppling != NULL) ? toppling->GetShape() : diss_toppling->GetShape();
+	shape.size = avalanche_size;
+	return avalanche_size;
+}
+
+/**
+ * The settings of the grids and the toppling procedures come from the configuration, they
+ * are not part of the state. The dissipation grid is only there for some toppling methods,
+ * and the grain grid is not there for Rossum2011_diss, just as on load.
+ */
+template <typename T>
+void SandPile<T>::StoreState(boost::archive::binary_oarchive & ar) {
+	if (grid != NULL) ar << *grid;
+	if (toppling != NULL) ar << *toppling;
+	if (diss_grid != NULL) ar << *diss_grid;
+	if (diss_toppling != NULL) ar << *diss_toppling;
+	ar << avalanches;
+	ar << drive_site;
+}
+
+/**
+ * The sandpile has to be created with the same configuration as the one that was stored.
+ */
+template <typename T>
+void SandPile<T>::LoadState(boost::archive::binary_iarchive & ar) {
+	if (grid != NULL) ar >> *grid;
+	if (toppling != NULL) ar >> *toppling;
+	if (diss_grid != NULL) ar >> *diss_grid;
+	if (diss_toppling != NULL) ar >> *diss_toppling;
+	ar >> avalanches;
+	ar >> drive_site;
+}
+
+/**
+ * The cache only has the cells, a trial that starts from it keeps its own counters, so the
+ * random numbers of its topplings still differ from those of the trial that stored them.
+ */
+template <typename T>
+void SandPile<T>::StoreCells(boost::archive::binary_oarchive & ar) {
+	if (grid != NULL) grid->SerializeCells(ar);
+	if (diss_grid != NULL) diss_grid->SerializeCells(ar);
+}
+
+/**
+ * The cells in the cache are relaxed, so no cell has to be activated.
+ */
+template <typename T>
+void SandPile<T>::LoadCells(boost::archive::binary_iarchive & ar) {
+	if (grid != NULL) grid->SerializeCells(ar);
+	if (diss_grid != NULL) diss_grid->SerializeCells(ar);
+}
+
 /**
  * Get values that seem to be relevant for debugging or (scientific) insight. With
  * the Plot class, they can be easily plotted in the form of a .ppm file. Very useful
  * to keep track of the heights of all cells at once. Or to see the structure of the
- * dissipation regions.
+ * dissipation regions. The values are row by row, whatever the layout of the grid.
  */
-void SandPile::GetValues(float *values, const GridValueType gvt) {
-	vector<Cell*> neighbours;
+template <typename T>
+void SandPile<T>::GetValues(float *values, const GridValueType gvt) {
+	const long int *neighbours;
+	int no_neighbours = 0;
+	GridBase *cells = (grid != NULL) ? (GridBase*)grid : (GridBase*)diss_grid;
 	for (int i = 0; i < L*L; ++i) {
+		// the values are row by row, whatever the layout of the grids
+		long int index = cells->GetIndex(i % L, i / L);
 		switch (gvt) {
 		case GVT_HEIGHT_SCALED:
-			values[i] = grid->GetCell(i).GetHeight() / (float)grid->GetCell(i).GetMaxCapacity();
+			values[i] = grid->GetCell(index).GetHeight() / (float)grid->GetCell(index).GetMaxCapacity();
 			break;
 		case GVT_HEIGHT:
-			values[i] = grid->GetCell(i).GetHeight();
+			values[i] = grid->GetCell(index).GetHeight();
 			break;
 		case GVT_NCN:
-			neighbours.clear();
-			grid->GetNeighbours(i % grid->GetWidth(), i / grid->GetWidth(), neighbours);
+			no_neighbours = grid->GetNeighbours(index, neighbours);
 			values[i] = 0;
-			for (unsigned int n = 0; n < neighbours.size(); ++n) {
-				if (neighbours[n]->GetHeight() >= toppling->GetToppleThreshold() - toppling->GetDissipationAmount() / neighbours.size()) values[i] = 1.0; //++;
-//				if (neighbours[n]->GetHeight() >= toppling->GetToppleThreshold()) values[i] = 1.0; //++;
+			for (int n = 0; n < no_neighbours; ++n) {
+				if (grid->GetHeights()[neighbours[n]] >= toppling->GetToppleThreshold() - toppling->GetDissipationAmount() / no_neighbours) values[i] = 1.0; //++;
+//				if (grid->GetHeights()[neighbours[n]] >= toppling->GetToppleThreshold()) values[i] = 1.0; //++;
 			}
-//			values[i] = values[i] / neighbours.size();
+//			values[i] = values[i] / no_neighbours;
 			break;
 		case GVT_CRITICAL_CELLS:
-			values[i] = (grid->GetCell(i).GetHeight() >= (toppling->GetToppleThreshold() - toppling->GetDissipationAmount() / neighbours.size()) ? grid->GetCell(i).GetMaxCapacity() : 0);
+			values[i] = (grid->GetCell(index).GetHeight() >= (toppling->GetToppleThreshold() - toppling->GetDissipationAmount() / no_neighbours) ? grid->GetCell(index).GetMaxCapacity() : 0);
 			break;
 		case GVT_DISSIPATION:
 			if (diss_grid == NULL) {
@@ -283,14 +399,21 @@ void SandPile::GetValues(float *values, const GridValueType gvt) {
 			}
 			//			if ((!i % L)) cout << endl;
 			//			cout << diss_grid->GetCell(i).GetHeight() << " ";
-			values[i] = diss_grid->GetCell(i).GetHeight() / (float)diss_grid->GetCell(i).GetMaxCapacity();
+			values[i] = diss_grid->GetCell(index).GetHeight() / (float)diss_grid->GetCell(index).GetMaxCapacity();
 			break;
 		case GVT_DIRECTION:
 			if (diss_grid == NULL) {
 				cerr << __FUNCTION__ << ": There is no dissipation grid!" << endl;
 				assert (false);
 			}
-			values[i] = diss_grid->GetCell(i).GetDirection() / (float)4;
+			values[i] = diss_grid->GetCell(index).GetDirection() / (float)4;
+			break;
+		case GVT_BOUNDARY_OUTFLOW:
+		case GVT_BULK_DISSIPATION:
+			cerr << "Not implemented per cell, use GetValue" << endl;
+			assert (false);
+			break;
+		default: // GVT_ORDERPARAM1 is done below
 			break;
 		}
 			}
@@ -303,7 +426,8 @@ void SandPile::GetValues(float *values, const GridValueType gvt) {
 /**
  * Fill the given array of values with the number of grains in "patches".
  */
-void SandPile::Coarsen(float *values, int array_size, int patch_L) {
+template <typename T>
+void SandPile<T>::Coarsen(float *values, int array_size, int patch_L) {
 	if (patch_L == 1) {
 		GetValues(values, GVT_HEIGHT);
 		return;
@@ -328,25 +452,52 @@ void SandPile::Coarsen(float *values, int array_size, int patch_L) {
 }
 
 /**
- * Get average/total value. Maybe "misuse" grid->reservoir cell. However... this does for
- * most models only capture boundary dissipation. Each time bulk dissipation occurs it is
- * just by decrementing a cell more than incrementing its neighbours, and this is nowhere
- * stored. Hence, for slower but more faithful execution use CountGrains for now.
+ * Add every height with the number of cells at that height to the counter. Real-valued
+ * heights are truncated to a thousandth of a grain. This needs the histogram of the grid, so
+ * it only has to go over the heights that occur, not over the cells.
+ */
+template <typename T>
+void SandPile<T>::CountHeights(LogHistogram<double> & counter) {
+	HeightHistogram<T> *histogram = grid->GetHistogram();
+	if (histogram == NULL) {
+		cerr << "Call SetHeightHistogram first!" << endl;
+		assert(false);
+		return;
+	}
+	for (long int b = histogram->Next(histogram->Begin()); b < histogram->End();
+			b = histogram->Next(b + 1)) {
+		counter.AddEvent(HeightHistogram<T>::Value(b), histogram->Count(b));
+	}
+}
+
+/**
+ * Get average/total value. The reservoir cell is not used for this, it would only capture
+ * boundary dissipation and wraps around for small types. The grid keeps a running total of
+ * its grains, and the toppling procedure counts the grains that go to the reservoir and the
+ * grains that disappear in the bulk (a cell decremented more than its neighbours are
+ * incremented). So these values do not need a pass over the grid.
  */
-void SandPile::GetValue(long int &value, const GridValueType gvt) {
+template <typename T>
+void SandPile<T>::GetValue(long int &value, const GridValueType gvt) {
 	switch(gvt) {
 	case GVT_HEIGHT_SCALED:
-		value = grid->CountGrains();
+		value = grid->GetGrains();
 		break;
 	case GVT_CRITICAL_CELLS:
 		value = toppling->CountCriticalCells();
 		break;
-	case GVT_DISSIPATION: //todo
+	case GVT_DISSIPATION:
 		if (diss_grid == NULL) {
 			cerr << "There is no dissipation grid!" << endl;
 			assert (false);
 		}
-		value = -1;
+		value = diss_grid->GetGrains();
+		break;
+	case GVT_BOUNDARY_OUTFLOW:
+		value = toppling->GetBoundaryOutflow();
+		break;
+	case GVT_BULK_DISSIPATION:
+		value = toppling->GetBulkDissipation();
 		break;
 	case GVT_DIRECTION: //todo?
 		if (diss_grid == NULL) {
@@ -366,8 +517,18 @@ void SandPile::GetValue(long int &value, const GridValueType gvt) {
 /**
  * Print whatever is relevant for now...
  */
-void SandPile::Print() {
+template <typename T>
+void SandPile<T>::Print() {
 	//	avalanches.Print(0);
 	if (diss_grid != NULL) diss_grid->Print();
 	//	avalanches.Print(1);
 }
+
+/* **************************************************************************************
+ * Explicit instantiations of SandPile
+ * **************************************************************************************/
+
+template class SandPile<uint8_t>;
+template class SandPile<int32_t>;
+template class SandPile<float>;
+template class SandPile<double>;
@@ -98,6 +98,9 @@ void AlterConfig(Config &config) {
 
 	cout << "Take care that config.skip is large enough for your system size!" << endl;
 
+	// the duration, radius and extent of avalanches, at the cost of the faster relaxation
+//	AddShapeFigures(config);
+
 	ostringstream t;
 
 	std::map<PlotFigureType,FigureConfig>::iterator i;
@@ -141,6 +144,38 @@ void AlterConfig(Config &config) {
 		(*i).second.title = t.str();
 	}
 
+	i = config.figures.find(PFT_AvalancheArea);
+	if (i != config.figures.end()) {
+		t.clear(); t.str("");
+		t << "Avalanche area, model=" << config.toppling_method <<
+				" (L=" << config.system_size << ")" << " (T=" << config.timespan << ")";
+		(*i).second.title = t.str();
+	}
+
+	i = config.figures.find(PFT_AvalancheDuration);
+	if (i != config.figures.end()) {
+		t.clear(); t.str("");
+		t << "Avalanche duration, model=" << config.toppling_method <<
+				" (L=" << config.system_size << ")" << " (T=" << config.timespan << ")";
+		(*i).second.title = t.str();
+	}
+
+	i = config.figures.find(PFT_AvalancheRadius);
+	if (i != config.figures.end()) {
+		t.clear(); t.str("");
+		t << "Avalanche radius, model=" << config.toppling_method <<
+				" (L=" << config.system_size << ")" << " (T=" << config.timespan << ")";
+		(*i).second.title = t.str();
+	}
+
+	i = config.figures.find(PFT_AvalancheExtent);
+	if (i != config.figures.end()) {
+		t.clear(); t.str("");
+		t << "Avalanche extent, model=" << config.toppling_method <<
+				" (L=" << config.system_size << ")" << " (T=" << config.timespan << ")";
+		(*i).second.title = t.str();
+	}
+
 	config.Print();
 }
 
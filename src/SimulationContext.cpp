@@ -0,0 +1,90 @@
+/**
+ * @file SimulationContext.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+// General files
+#include <SimulationContext.h>
+#include <iostream>
+
+using namespace std;
+
+/* **************************************************************************************
+ * Implementation of SimulationContext
+ * **************************************************************************************/
+
+/**
+ * The default feeds are the ones that were used before there was a configuration file.
+ */
+SimulationContext::SimulationContext(int stream): stream(stream) {
+	SetDefaultFeeds();
+}
+
+/**
+ * The feeds are in the order of FeedType. If there are not enough feeds, the default ones
+ * are used for the missing ones.
+ */
+SimulationContext::SimulationContext(const vector<int> & feeds, int stream): stream(stream) {
+	SetDefaultFeeds();
+	if (feeds.size() < NO_FEED_TYPES) {
+		cerr << "Not enough feeds for random generators!" << endl;
+	}
+	for (int f = 0; (f < NO_FEED_TYPES) && (f < (int)feeds.size()); ++f) {
+		SetFeed((FeedType)f, feeds[f]);
+	}
+}
+
+/**
+ * Default destructor
+ */
+SimulationContext::~SimulationContext() { }
+
+/**
+ * Set all feeds to their defaults.
+ */
+void SimulationContext::SetDefaultFeeds() {
+	SetFeed(FT_GRID, 230895);
+	SetFeed(FT_TOPPLING, 9237593);
+	SetFeed(FT_DIRECTION, 33480);
+	SetFeed(FT_DRIVE, 233480);
+	SetFeed(FT_DISSIPATION, 1233480);
+	SetFeed(FT_NEIGHBOUR, 334340);
+}
+
+/**
+ * The generators are seeded again, so they start from the beginning with the new feed.
+ */
+void SimulationContext::SetFeed(FeedType type, int feed) {
+	feeds[type] = feed;
+	generators[type].seed(Seed(feed));
+	counter_randoms[type].SetKey(feed, stream);
+}
+
+/**
+ * Stream 0 uses the feed itself. Other streams mix the stream number into the feed (as in
+ * boost::hash_combine), so neighbouring streams do not end up with neighbouring seeds.
+ */
+uint32_t SimulationContext::Seed(int feed) {
+	uint32_t seed = feed;
+	if (stream == 0) return seed;
+	seed ^= (uint32_t)stream * 2654435761u + 0x9e3779b9u + (seed << 6) + (seed >> 2);
+	return seed;
+}
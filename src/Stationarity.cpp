@@ -0,0 +1,87 @@
+/**
+ * @file Stationarity.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+// General files
+#include <Stationarity.h>
+
+#include <cmath>
+#include <cassert>
+
+/* **************************************************************************************
+ * Implementation of Stationarity
+ * **************************************************************************************/
+
+/**
+ * The window is rounded up to an even number of batches, with at least two per half, so
+ * each half has a variance.
+ */
+Stationarity::Stationarity(long int batch_size, int window, double z): batch_size(batch_size),
+		window(window), z(z) {
+	assert (batch_size > 0);
+	if (this->window < 4) this->window = 4;
+	if (this->window % 2) this->window++;
+	Clear();
+}
+
+/**
+ * Default destructor
+ */
+Stationarity::~Stationarity() { }
+
+/**
+ * Start again, as for a new series.
+ */
+void Stationarity::Clear() {
+	sum = 0;
+	count = 0;
+	values = 0;
+	means.clear();
+	stationary = false;
+}
+
+/**
+ * The test is that of Geweke, on batch means: the difference of the means of the two halves
+ * of the window, divided by its standard error. A trend makes the difference large compared
+ * to the spread within the halves.
+ */
+void Stationarity::Batch() {
+	means.push_back(sum / count);
+	sum = 0;
+	count = 0;
+	if ((int)means.size() > window) means.pop_front();
+	if ((int)means.size() < window) return;
+
+	int half = window / 2;
+	double mean[2] = { 0, 0 }, variance[2] = { 0, 0 };
+	for (int h = 0; h < 2; ++h) {
+		for (int b = 0; b < half; ++b) mean[h] += means[h*half + b];
+		mean[h] /= half;
+		for (int b = 0; b < half; ++b) {
+			double d = means[h*half + b] - mean[h];
+			variance[h] += d * d;
+		}
+		variance[h] /= half - 1;
+	}
+	double error = sqrt((variance[0] + variance[1]) / half);
+	stationary = (fabs(mean[1] - mean[0]) <= z * error);
+}
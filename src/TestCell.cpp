@@ -23,7 +23,7 @@
 #include <TestCell.h>
 #include <Grid.h>
 
-TestCell::TestCell(Grid *grid) {
+TestCell::TestCell(Grid<GrainType> *grid) {
 	this->grid = grid;
 }
 
@@ -32,5 +32,6 @@ TestCell::~TestCell() {
 }
 
 void TestCell::SetHeight(int i, GrainType value) {
-	grid->GetCell(i).height = value;
+	Cell<GrainType> cell = grid->GetCell(i);
+	cell.Increase(value - cell.GetHeight());
 }
@@ -25,6 +25,11 @@
 #include <Toppling.h>
 #include <assert.h>
 
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#include <boost/bind.hpp>
 #include <boost/random/uniform_smallint.hpp>
 #include <boost/random/uniform_01.hpp>
 
@@ -32,27 +37,9 @@ using namespace std;
 using namespace boost;
 
 /* **************************************************************************************
- * Implementation of Toppling
+ * Implementation of TopplingBase
  * **************************************************************************************/
 
-// Static members
-
-int Toppling::grid_feed = 230895;
-
-int Toppling::toppling_feed = 9237593;
-
-/**
- * Randomize cells over grid
- */
-ptrdiff_t boost_random (ptrdiff_t size) {
-	static boost::mt19937 randomGenerator(Toppling::GetGridFeed());
-	uniform_smallint<size_t> distr(0, size-1);
-	return distr(randomGenerator);
-}
-
-// pointer object to it:
-ptrdiff_t (*p_boost_random)(ptrdiff_t) = boost_random;
-
 /**
  * Stream operator to use TopplingMethod in stdout, to file, etc.
  */
@@ -69,83 +56,52 @@ std::ostream& operator<<( std::ostream& os, const TopplingMethod& method) {
 }
 
 /**
- * A toppling method is coupled to a sand_grid. The class understands a few different methods
- * named after authors of papers. They differ in toppling probability and the threshold
- * upon which a cell becomes critical.
+ * The settings that do not depend on the type of the heights.
  */
-Toppling::Toppling(Grid *grid): sand_grid(grid),
-		diss_grid(NULL),
+TopplingBase::TopplingBase(long int no_cells, SimulationContext & context): no_cells(no_cells),
 		noDuringAvalanches(NULL),
 		countDuringAvalanches(false),
-		topple_threshold(4),
+		measure_waves(false),
+		measure_extent(false),
+		active_cells(no_cells),
+		allow_abelian(true),
+		tiled(false),
 		dissipative_mode(false),
 		diss_rate(0.1),
-		diss_threshold(0),
 		diss_amount(4),
 		toppling_method(TM_UNDEFINED),
 		toppling_iterator(FOLLOW_ACTIVITY),
-		random_indices(NULL) {
+		random_indices(NULL),
+		select_kernel(true),
+		context(&context),
+		boundary_outflow(0),
+		bulk_dissipation(0) {
+	extent.Clear();
+	shape.size = shape.area = shape.waves = 0;
+	shape.radius = 0;
+	shape.left = shape.right = shape.top = shape.bottom = -1;
 }
 
 /**
- * Set toppling method and the corresponding default threshold for toppling. This can
- * be overwritten by using SetTopplingThreshold.
- */
-void Toppling::SetTopplingMethod(TopplingMethod toppling_method) {
-	this->toppling_method = toppling_method;
-	switch(toppling_method) {
-	case Manna_Lin2010:
-		topple_threshold = 2;
-		break;
-	case Lin_etal2006:
-	case Rossum2011:
-	case Bak_Tang_Wiesenfeld1987:
-		topple_threshold = 4;
-		break;
-	case Rossum2011_diss:
-		topple_threshold = 0;
-		break;
-	case TM_UNDEFINED:
-		cerr << "Undefined toppling method" << endl;
-		assert(false);
-		break;
-	}
-}
-
-/**
- * Overwrite toppling threshold. First set SetTopplingMethod. A warning is written to
- * stderr if the threshold is non-default. If the threshold is below zero the default
- * threshold is set again.
- */
-void Toppling::SetTopplingThreshold(GrainType threshold) {
-	assert (toppling_method != TM_UNDEFINED);
-	if (threshold < 0) {
-		SetTopplingMethod(toppling_method);
-	} else if (threshold != topple_threshold) {
-		cerr << "Non-standard toppling threshold: " << threshold << endl;
-		topple_threshold = threshold;
-	}
-}
-
-/**
- * There are three ways with which we can go "through" the grid. We can "follow" the activity
+ * There are several ways with which we can go "through" the grid. We can "follow" the activity
  * which is really convenient for avalanche dynamics: cells that do not topple will not change
  * anyway. There are also random functions in case someone wants to implement global dissipation
  * (different from bulk dissipation which only occurs at avalanche fronts). It can also be used
- * for a different type of (parallel) grid - as in Rossum2011.
+ * for a different type of (parallel) grid - as in Rossum2011. The synchronous iterator goes
+ * over the entire grid as well, but in order and with all unstable cells toppling at once.
  */
-void Toppling::SetTopplingIterator(TopplingIterator toppling_iterator) {
+void TopplingBase::SetTopplingIterator(TopplingIterator toppling_iterator) {
 	this->toppling_iterator = toppling_iterator;
-	int size;
+	select_kernel = true;
 	switch(toppling_iterator) {
 	case RANDOM_FRACTION:
 	case RANDOM_ALL:
-		size = sand_grid->GetWidth()*sand_grid->GetHeight();
-		random_indices = new int[size];
-		for (int i = 0; i < size; i++) random_indices[i] = i;
+		random_indices = new int[no_cells];
+		for (int i = 0; i < no_cells; i++) random_indices[i] = i;
 		break;
 	case FOLLOW_ACTIVITY:
-		active_cells.clear();
+	case SYNCHRONOUS: // every step goes over all cells, there is no need for active cells
+		active_cells.Clear();
 		break;
 	}
 }
@@ -155,7 +111,7 @@ void Toppling::SetTopplingIterator(TopplingIterator toppling_iterator) {
  * function overwrites this default (and spits out a warning in that case). It can be used
  * for comparative research.
  */
-void Toppling::SetDissipativeMode(bool mode) {
+void TopplingBase::SetDissipativeMode(bool mode) {
 	dissipative_mode = mode;
 	if(toppling_method == Lin_etal2006) {
 		if (!dissipative_mode) {
@@ -169,59 +125,182 @@ void Toppling::SetDissipativeMode(bool mode) {
  * Counting e.g. critical cells during avalanches is computationally expensive. So, there is
  * a boolean with which we can turn on/off this option (by this function).
  */
-void Toppling::SetCounterDuringAvalanches(bool count) {
+void TopplingBase::SetCounterDuringAvalanches(bool count) {
 	countDuringAvalanches = count;
+	select_kernel = true;
 
 	noDuringAvalanches = NULL;
 	if (countDuringAvalanches) {
-		noDuringAvalanches = new EventCounter<int>();
+		// the number of grains varies little around its mean, so with a fine precision
+		noDuringAvalanches = new LogHistogram<int>(1, 11);
 	}
 }
 
 /**
- * Set maximum cell capacity of the corresponding (sand) grid. There is a check in this
- * function that enforces a capacity of twice the toppling threshold. This is mainly to
- * protect the user and can be changed if you want to. However, it means you will need
- * to set the toppling threshold first...
+ * The waves are the iterations of the general toppling procedure. The dedicated relaxation
+ * for BTW and the tiles do not go wave by wave, so they are not used if the waves are counted.
  */
-void Toppling::SetCellCapacity(GrainType capacity) {
-	if (capacity < (2*topple_threshold)) {
-		cerr << "Probably you want to set capacity at least two times the " <<
-				"toppling threshold" << endl;
-//		assert (false);
-	}
-	if (!sand_grid) cerr << __FUNCTION__ << ": Grid is not set!" << endl;
-	int no_cells = sand_grid->GetWidth() * sand_grid->GetHeight();
-	for (int c = 0; c < no_cells; ++c) {
-		sand_grid->GetCell(c).SetMaxCapacity(capacity);
-	}
+void TopplingBase::SetMeasureWaves(bool measure) {
+	measure_waves = measure;
+	select_kernel = true;
+}
 
+/**
+ * The radius of gyration is the root mean square distance of the cells that toppled to their
+ * centre of mass: sqrt(<x^2+y^2> - <x>^2 - <y>^2). Each cell counts once, however often it
+ * toppled.
+ */
+void TopplingBase::SetShape(long int avalanche_size) {
+	shape.size = avalanche_size;
+	shape.area = extent.area;
+	shape.radius = 0;
+	shape.left = shape.right = shape.top = shape.bottom = -1;
+	if (extent.right >= 0) {
+		double x = extent.x / extent.area, y = extent.y / extent.area;
+		double variance = extent.squares / extent.area - x*x - y*y;
+		shape.radius = (variance > 0) ? sqrt(variance) : 0;
+		shape.left = extent.left; shape.right = extent.right;
+		shape.top = extent.top; shape.bottom = extent.bottom;
+	}
+	extent.Clear();
 }
 
 /**
- * Default destructor. If there is an array to iterate over the sand_grid in a random
- * way, it will be deleted. The sand_grid itself is just a pointer, so it will not be
- * deleted, but just set to NULL.
+ * If there is an array to iterate over the sand_grid in a random way, it will be deleted.
  */
-Toppling::~Toppling() {
+TopplingBase::~TopplingBase() {
 	toppling_method = TM_UNDEFINED;
 
 	switch(toppling_iterator) {
 	case RANDOM_FRACTION:
 	case RANDOM_ALL:
+	case SYNCHRONOUS:
 		delete [] random_indices;
 		break;
 	case FOLLOW_ACTIVITY:
-		active_cells.clear();
+		active_cells.Clear();
 		break;
 	}
-	diss_grid = NULL;
-	sand_grid = NULL;
 
 	if (noDuringAvalanches != NULL)
 		delete noDuringAvalanches;
 }
 
+/* **************************************************************************************
+ * Implementation of Toppling
+ * **************************************************************************************/
+
+/**
+ * A toppling method is coupled to a sand_grid. The class understands a few different methods
+ * named after authors of papers. They differ in toppling probability and the threshold
+ * upon which a cell becomes critical.
+ */
+template <typename T>
+Toppling<T>::Toppling(Grid<T> *grid): TopplingBase(grid->GetSize(), grid->GetContext()),
+		sand_grid(grid),
+		diss_grid(NULL),
+		histogram(NULL),
+		topple_threshold(4),
+		diss_threshold(0),
+		sweep_from(NULL),
+		sweep_to(NULL),
+		parallel_waves(false),
+		min_parallel_wave(256),
+		workers(NULL),
+		start_barrier(NULL),
+		done_barrier(NULL),
+		tile_barrier(NULL),
+		stop_workers(false),
+		wave_colour(0),
+		wave_kernel(NULL),
+		kernel(NULL) {
+	topple_counts.resize(no_cells + 1, 0);
+	visited.resize(no_cells, 0);
+	epoch = 0;
+	width = grid->GetWidth();
+	counter_random = &context->GetCounterRandom(FT_TOPPLING);
+	serial_lane.generator = &context->GetGenerator(FT_TOPPLING);
+	serial_lane.outflow = 0;
+	serial_lane.boundary_outflow = 0;
+	serial_lane.bulk_dissipation = 0;
+	serial_lane.topplings = 0;
+	serial_lane.extent.Clear();
+	serial_lane.words = NULL;
+	serial_lane.stride = 0;
+}
+
+/**
+ * Set toppling method and the corresponding default threshold for toppling. This can
+ * be overwritten by using SetTopplingThreshold.
+ */
+template <typename T>
+void Toppling<T>::SetTopplingMethod(TopplingMethod toppling_method) {
+	this->toppling_method = toppling_method;
+	select_kernel = true;
+	switch(toppling_method) {
+	case Manna_Lin2010:
+		topple_threshold = 2;
+		break;
+	case Lin_etal2006:
+	case Rossum2011:
+	case Bak_Tang_Wiesenfeld1987:
+		topple_threshold = 4;
+		break;
+	case Rossum2011_diss:
+		topple_threshold = 0;
+		break;
+	case TM_UNDEFINED:
+		cerr << "Undefined toppling method" << endl;
+		assert(false);
+		break;
+	}
+}
+
+/**
+ * Overwrite toppling threshold. First set SetTopplingMethod. A warning is written to
+ * stderr if the threshold is non-default. If the threshold is below zero the default
+ * threshold is set again.
+ */
+template <typename T>
+void Toppling<T>::SetTopplingThreshold(GrainType threshold) {
+	assert (toppling_method != TM_UNDEFINED);
+	if (threshold < 0) {
+		SetTopplingMethod(toppling_method);
+	} else if (threshold != topple_threshold) {
+		cerr << "Non-standard toppling threshold: " << threshold << endl;
+		topple_threshold = threshold;
+	}
+}
+
+/**
+ * Set maximum cell capacity of the corresponding (sand) grid. There is a check in this
+ * function that enforces a capacity of twice the toppling threshold. This is mainly to
+ * protect the user and can be changed if you want to. However, it means you will need
+ * to set the toppling threshold first...
+ */
+template <typename T>
+void Toppling<T>::SetCellCapacity(GrainType capacity) {
+	if (capacity < (2*topple_threshold)) {
+		cerr << "Probably you want to set capacity at least two times the " <<
+				"toppling threshold" << endl;
+//		assert (false);
+	}
+	if (!sand_grid) cerr << __FUNCTION__ << ": Grid is not set!" << endl;
+	sand_grid->SetMaxCapacity(capacity);
+
+}
+
+/**
+ * Default destructor. The sand_grid itself is just a pointer, so it will not be deleted,
+ * but just set to NULL.
+ */
+template <typename T>
+Toppling<T>::~Toppling() {
+	StopWorkers();
+	diss_grid = NULL;
+	sand_grid = NULL;
+}
+
 /**
  * Count the number of cells at criticality (depends on toppling method what
  * exactly this constitutes, but it means one grain below threshold for toppling in the case of
@@ -230,13 +309,27 @@ Toppling::~Toppling() {
  * cell might be increased with a value taken from the range from 0 till the dissipation amount,
  * most often a value around dissipation amount / neighbours (4). This function should be called
  * "PseudoCritical" in that case...
+ *
+ * If the grid keeps a histogram of the heights the count is read from it, without going over
+ * the grid. With real-valued heights it counts the cells within a thousandth of a grain above
+ * the critical height then, see HeightHistogram.
  */
-long int Toppling::CountCriticalCells() {
-	int no_cells = sand_grid->GetWidth() * sand_grid->GetHeight();
+template <typename T>
+long int Toppling<T>::CountCriticalCells() {
+	// a dissipation amount of zero or less means one grain per neighbour, as in Topple
+	GrainType amount = (diss_amount <= 0) ? 4 : diss_amount;
+	GrainType critical = topple_threshold - amount / 4;
+	HeightHistogram<T> *bins = sand_grid->GetHistogram();
+	if (bins != NULL) {
+		long int bin = HeightHistogram<T>::Bin((T)critical);
+		if (std::numeric_limits<T>::is_integer && (bin != critical)) return 0;
+		return bins->Count(bin);
+	}
 
+	T *heights = sand_grid->GetHeights();
 	long int sum = 0;
-	for (int c = 0; c < no_cells; ++c) {
-		if (sand_grid->GetCell(c).GetHeight() == topple_threshold - GetDissipationAmount() / 4);
+	for (long int c = 0; c < no_cells; ++c) {
+		if (heights[c] == critical)
 			sum++;
 	}
 	return sum;
@@ -244,145 +337,451 @@ long int Toppling::CountCriticalCells() {
 
 /**
  * Topple grains from a specific cell to its neighbours. Read the corresponding
- * papers for the - sometimes minute - differences.
+ * papers for the - sometimes minute - differences. The toppling method M is a template
+ * parameter, so the switch below is resolved at compile time. Random numbers are only
+ * drawn if the cell actually topples and the method needs them. They are tied to the cell
+ * and the number of times it toppled before, see FillRandom. Cells are (de)activated
+ * inline, directly after their height changed. If the cell is toppled in a parallel wave
+ * or in a tile the lane collects the unstable cells and the grains for the reservoir instead,
+ * see Route.
  */
-bool Toppling::Topple(Cell & cell, vector<Cell*> & neighbours) {
-	bool topple = false;
+template <typename T>
+template <TopplingMethod M, TopplingIterator I, typename Toppling<T>::Route R>
+inline bool Toppling<T>::Topple(long int index, const long int *neighbours, int no_neighbours,
+		Lane & lane) {
+	T *heights = sand_grid->GetHeights();
+	if (heights[index] < topple_threshold) return false;
+	bool topple = true;
 
-	//! The Mersenne Twister random generator
-	static boost::mt19937 randomGenerator(Toppling::GetTopplingFeed());
-	uniform_smallint<size_t> distr(0, neighbours.size()-1);
+	// the words 0..3 choose the neighbours (Manna) or dissipate (Lin), the last four words
+	// divide the grains over the neighbours (real heights)
+	const int no_words = RandomWords<M>();
+	const uint32_t *words = lane.words;
+	long int stride = lane.stride;
+	uint32_t own_words[8];
+	if (no_words > 0) {
+		if (words == NULL) {
+			for (int b = 0; b < no_words / 4; ++b) {
+				counter_random->Block(index, topple_counts[index], b, 0, own_words + 4*b);
+			}
+			words = own_words;
+			stride = 1;
+		}
+		topple_counts[index]++;
+	}
 
 	// default is to transfer one grain to each neighbour: diss_amount = topple_threshold = 4
-	GrainType decrease = ((diss_amount <= 0) ? neighbours.size() : diss_amount);
+	T decrease = ((diss_amount <= 0) ? no_neighbours : diss_amount);
 
-	bool uniform_increase = false;
+	// BTW is deterministic, all other models divide the grains randomly over the neighbours,
+	// except with integer heights, then there are no fractions of grains to divide
+	const bool uniform_increase = (M == Bak_Tang_Wiesenfeld1987) ||
+			std::numeric_limits<T>::is_integer;
 
-	GrainType increase_neighbour[neighbours.size()];
-	if (uniform_increase) {
-		// the increase of each neighbour is exactly 1/# neighbours of total decrease
-		for (unsigned int i = 0; i < neighbours.size(); ++i) increase_neighbour[i] = decrease / neighbours.size();
-	} else {
+	// the increase of each neighbour is exactly 1/# neighbours of total decrease
+	T increase = decrease / no_neighbours;
+
+	// grains that went to the neighbours, including the reservoir
+	GrainType delivered = 0;
+
+	T increase_neighbour[4];
+	if (!uniform_increase && (M != Rossum2011_diss)) {
 		// create 4 random values that add up to decrease...
-		static boost::uniform_01<boost::mt19937> zeroone(randomGenerator);
-		GrainType sum_increase = 0;
-		for (unsigned int i = 0; i < neighbours.size(); ++i) {
-			increase_neighbour[i] = zeroone();
+		T sum_increase = 0;
+		for (int i = 0; i < no_neighbours; ++i) {
+			increase_neighbour[i] = CounterRandom::Uniform(words[(no_words - 4 + i) * stride]);
 			sum_increase += increase_neighbour[i];
 		}
 
 		// normalise such that total sum becomes "increase"
-		GrainType corr_factor = decrease / sum_increase;
-		for (unsigned int i = 0; i < neighbours.size(); ++i) increase_neighbour[i] *= corr_factor;
+		T corr_factor = decrease / sum_increase;
+		for (int i = 0; i < no_neighbours; ++i) increase_neighbour[i] *= corr_factor;
 	}
 
 	// make sure total "increase" equals "decrease " (bulk conservative)
 //	assert (sum_increase == decrease);
 
-	if (cell.GetHeight() >= topple_threshold) {
-		topple = true;
+	switch(M) {
+	case Manna_Lin2010: { // stochastic, but conserves sand quantity
+		Decrease<I, R>(index, decrease, lane);
+		for (int n = 0; n < no_neighbours; ++n) {
+			int neigh = CounterRandom::Below(words[n * stride], no_neighbours);
+			T amount = uniform_increase ? increase : increase_neighbour[n];
+			Increase<I, R>(neighbours[neigh], amount, lane);
+			delivered += amount;
+		}
+		break;
+	}
+	case Bak_Tang_Wiesenfeld1987: {
+		// it is absolutely not clear from the paper what happens to boundary sites where there is a wall
+		// I want to preserve the determinism and conservation along the non-dissipatory border
+		// so we do not decrease by topple_threshold, but by the number of neighbours
+		Decrease<I, R>(index, decrease, lane); // deterministic, conserved
+		for (int n = 0; n < no_neighbours; ++n) {
+			Increase<I, R>(neighbours[n], increase, lane);
+		}
+		delivered = no_neighbours * (GrainType)increase;
+		break;
+	}
+	case Lin_etal2006: {
+		Decrease<I, R>(index, decrease, lane);
 
-		switch(toppling_method) {
-		case Manna_Lin2010: { // stochastic, but conserves sand quantity
-			cell.Decrease(decrease);
-			for (unsigned int n = 0; n < neighbours.size(); ++n) {
-				int neigh = distr(randomGenerator);
-				neighbours[neigh]->Increase(increase_neighbour[n]);
+		if (dissipative_mode) {
+			for (int n = 0; n < no_neighbours; ++n) {
+				if (CounterRandom::Uniform(words[n * stride]) > diss_rate) {
+					T amount = uniform_increase ? increase : increase_neighbour[n];
+					Increase<I, R>(neighbours[n], amount, lane);
+					delivered += amount;
+				}
 			}
-			break;
-		}
-		case Bak_Tang_Wiesenfeld1987: {
-			// it is absolutely not clear from the paper what happens to boundary sites where there is a wall
-			// I want to preserve the determinism and conservation along the non-dissipatory border
-			// so we do not decrease by topple_threshold, but by the number of neighbours
-			cell.Decrease(decrease); // deterministic, conserved
-			for (unsigned int n = 0; n < neighbours.size(); ++n) {
-				neighbours[n]->Increase(increase_neighbour[n]);
+		} else {
+			// similar as BTW, bulk-conservation, different from authors!
+			for (int n = 0; n < no_neighbours; ++n) {
+				T amount = uniform_increase ? increase : increase_neighbour[n];
+				Increase<I, R>(neighbours[n], amount, lane);
+				delivered += amount;
 			}
-			break;
 		}
-		case Lin_etal2006: {
-			cell.Decrease(decrease);
-
-			if (dissipative_mode) {
-				for (unsigned int n = 0; n < neighbours.size(); ++n) {
-					static boost::uniform_01<boost::mt19937> zeroone(randomGenerator);
-					if (zeroone() > diss_rate)
-						neighbours[n]->Increase(increase_neighbour[n]);
-				}
-			} else {
-				// similar as BTW, bulk-conservation, different from authors!
-				for (unsigned int n = 0; n < neighbours.size(); ++n) {
-					neighbours[n]->Increase(increase_neighbour[n]);
-				}
+		break;
+	}
+	case Rossum2011_diss: {
+		// dissipative in specific spatial locations
+		topple = false; // toppling ceases directly...
+
+		// if cell has a certain weight, transfer one grain to a neighbour in the given direction
+		if (heights[index] > 0) {
+			unsigned char *directions = sand_grid->GetDirections();
+			int dir = directions[index];
+			sand_grid->GetCell(index).Transfer(sand_grid->GetCell(neighbours[dir]), 1);
+			directions[neighbours[dir]] = dir;
+
+			boost::mt19937 & randomGenerator = *lane.generator;
+			boost::uniform_01<double> zeroone;
+			float f = 0.01;
+			if (zeroone(randomGenerator) < f) {
+				uniform_smallint<size_t> distr(0, no_neighbours-1);
+				int dir2 = distr(randomGenerator); //(dir + 2) % 4;
+				int dir1 = distr(randomGenerator); //(dir + 1) % 4;
+				directions[neighbours[dir2]] = dir1;
 			}
-			break;
 		}
-		case Rossum2011_diss: {
-			// dissipative in specific spatial locations
-			topple = false; // toppling ceases directly...
-
-			// if cell has a certain weight, transfer one grain to a neighbour in the given direction
-			if (cell.GetHeight() > 0) {
-				int dir = cell.GetDirection();
-				cell.Transfer(*neighbours[dir], 1);
-				neighbours[dir]->SetDirection(dir);
-
-				float f = 0.01;
-				static boost::uniform_01<boost::mt19937> zeroone(randomGenerator);
-				if (zeroone() < f) {
-					int dir2 = distr(randomGenerator); //(dir + 2) % 4;
-					int dir1 = distr(randomGenerator); //(dir + 1) % 4;
-					neighbours[dir2]->SetDirection(dir1);
-				}
+		break;
+	}
+	case Rossum2011: {
+		assert (diss_threshold > 0);
+		T diss = diss_grid->GetHeights()[index];
+		Decrease<I, R>(index, decrease, lane);
+
+		// deterministic, like Bak_Tang_Wiesenfeld1987, but with threshold
+		// if diss. factor is above a certain threshold, the grains will disappear and
+		// the height of the neighbours will not be increased
+		if (diss >= diss_threshold) {
+			//cout << "Remove 4 grains" << endl;
+		} else {
+			for (int n = 0; n < no_neighbours; ++n) {
+				T amount = uniform_increase ? increase : increase_neighbour[n];
+				Increase<I, R>(neighbours[n], amount, lane);
+				delivered += amount;
 			}
-			break;
 		}
-		case Rossum2011: {
-			assert (diss_threshold > 0);
-			GrainType diss = diss_grid->GetCell(cell.GetId()).GetHeight();
-			cell.Decrease(decrease);
-
-			// deterministic, like Bak_Tang_Wiesenfeld1987, but with threshold
-			// if diss. factor is above a certain threshold, the grains will disappear and
-			// the height of the neighbours will not be increased
-			if (diss >= diss_threshold) {
-				//cout << "Remove 4 grains" << endl;
-			} else {
-				for (unsigned int n = 0; n < neighbours.size(); ++n) {
-					neighbours[n]->Increase(increase_neighbour[n]);
-				}
+		break;
+	}
+	case TM_UNDEFINED: {
+		cerr << "Undefined toppling method" << endl;
+		assert(false);
+	}
+	}
+
+	// what did not go to a neighbour or the reservoir disappeared in the bulk
+	if (topple) {
+		lane.bulk_dissipation += decrease - delivered;
+		Visit(index, lane);
+	}
+	return topple;
+}
+
+/**
+ * The random words of a toppling are those of the counter (cell, number of topplings of the
+ * cell so far, block, 0) of the counter-based generator. Hence the k-th toppling of a cell
+ * always gets the same words, whatever the order of the topplings and whatever thread does
+ * it. With integer heights the stochastic models become Abelian in this way: the serial
+ * procedure, the parallel waves and the tiles end in the same configuration.
+ *
+ * Every cell of a wave topples once at most, so the words for the whole wave (or stripe) are
+ * made in one go, which is a lot faster than one cell at a time. Word w of cell c ends up
+ * at random[w*no_cells+c]. If the method does not need random words, stride is 0.
+ */
+template <typename T>
+template <TopplingMethod M>
+void Toppling<T>::FillRandom(const long int *cells, long int no_cells, Lane & lane) {
+	const int no_words = RandomWords<M>();
+	lane.stride = 0;
+	if (no_words == 0) return;
+	lane.counters.resize(2 * no_cells);
+	lane.random.resize(no_words * no_cells);
+	for (long int c = 0; c < no_cells; ++c) {
+		lane.counters[c] = cells[c];
+		lane.counters[no_cells + c] = topple_counts[cells[c]];
+	}
+	for (int b = 0; b < no_words / 4; ++b) {
+		counter_random->Blocks(&lane.counters[0], &lane.counters[no_cells], b, 0, no_cells,
+				&lane.random[4 * b * no_cells]);
+	}
+	lane.stride = no_cells;
+}
+
+/**
+ * The BTW model is deterministic and Abelian: the final configuration and the total number of
+ * topplings do not depend on the order in which unstable cells are toppled. Hence we do not
+ * need waves, shuffling or random numbers. This is only the case if every neighbour gets
+ * exactly one grain per toppling, hence the decrease should be the number of neighbours.
+ * With walls this is only true if the dissipation amount is not set (the default), because
+ * cells at a wall have less than four neighbours.
+ */
+template <typename T>
+bool Toppling<T>::IsAbelian() {
+	if (!allow_abelian) return false;
+	if (toppling_method != Bak_Tang_Wiesenfeld1987) return false;
+	if (toppling_iterator != FOLLOW_ACTIVITY) return false;
+	if (countDuringAvalanches || measure_waves) return false;
+	switch (sand_grid->GetBoundaryType()) {
+	case BT_FULLY_CONNECTED: case BT_UNDEFINED:
+		return false;
+	case BT_WALL_DISSIPATING:
+		return (diss_amount <= 0);
+	default:
+		return ((diss_amount <= 0) || (diss_amount == 4));
+	}
+}
+
+/**
+ * Relaxation for the deterministic BTW model. The unstable cells are kept on a plain stack.
+ * A cell that is taken from the stack topples as many times as needed to become stable
+ * at once, and its neighbours receive one grain per toppling. A neighbour is pushed on the
+ * stack only at the moment it becomes unstable, so it is never twice on the stack. The
+ * avalanche size is the total number of topplings, just as in Topple. The heights are
+ * written directly, so CheckCell is not called: after relaxation there are no active
+ * cells anyway.
+ *
+ * Whether a neighbour becomes unstable cannot be predicted, so it is always written on top
+ * of the stack and the top only moves up if it did, without a branch. Mostly a cell topples
+ * once, so the division for the number of topplings is only done if it topples more often.
+ * The changes to the histogram of small whole heights are counted apart, see CountMove, in
+ * an array per neighbour so the counts of subsequent grains do not wait for each other. A
+ * neighbour that receives a single grain only counts the height it came from in gains.
+ */
+template <typename T>
+template <BoundaryType B>
+void Toppling<T>::ToppleAbelian(long int & avalanche_size) {
+	T *heights = sand_grid->GetHeights();
+	long int reservoir = sand_grid->GetReservoir();
+	const long int *neighbours;
+	long int scratch[4];
+	long int threshold = (long int)topple_threshold;
+	GrainType outflow = 0;
+	HeightHistogram<T> *bins = sand_grid->GetHistogram();
+	long int moves[5][SmallHeights], gains[4][SmallHeights];
+	if (bins != NULL) std::fill(moves[0], moves[5], 0), std::fill(gains[0], gains[4], 0);
+
+	vector<long int> & wave = active_cells.NextWave();
+	unstable_cells.assign(wave.begin(), wave.end());
+	long int top = unstable_cells.size();
+
+	while (top > 0) {
+		// room for four neighbours on top of the stack
+		if (top + 4 > (long int)unstable_cells.size()) unstable_cells.resize(2 * top + 4);
+		long int *stack = &unstable_cells[0];
+		long int index = stack[--top];
+		T height = heights[index];
+		if (height < topple_threshold) continue;
+
+		int no_neighbours = sand_grid->template GetNeighbours<B>(index, neighbours, scratch);
+		long int decrease = ((diss_amount <= 0) ? no_neighbours : (long int)diss_amount);
+
+		// topple till stable in one go, heights are whole numbers in BTW
+		long int excess = (long int)height - threshold;
+		long int topplings = (excess < decrease) ? 1 : excess / decrease + 1;
+		heights[index] = height - topplings * decrease;
+		if (bins != NULL) CountMove(moves[4], bins, height, heights[index]);
+		avalanche_size += topplings;
+		Visit(index, serial_lane);
+
+		for (int n = 0; n < no_neighbours; ++n) {
+			long int neighbour = neighbours[n];
+			T before = heights[neighbour];
+			heights[neighbour] = before + topplings;
+			bool inside = (B == BT_PERIODIC) || (neighbour != reservoir);
+			if (!inside) outflow += topplings;
+			else if (bins != NULL) {
+				long int from = (long int)before;
+				if ((topplings == 1) && (from == before) && ((unsigned long int)from < SmallHeights - 1))
+					gains[n & 3][from]++;
+				else CountMove(moves[n & 3], bins, before, heights[neighbour]);
 			}
-			break;
+			stack[top] = neighbour;
+			top += inside & (before < topple_threshold) & (before + topplings >= topple_threshold);
 		}
-		case TM_UNDEFINED: {
-			cerr << "Undefined toppling method" << endl;
-			assert(false);
+	}
+	unstable_cells.clear();
+
+	if (bins != NULL) {
+		for (int h = 0; h + 1 < SmallHeights; ++h) {
+			long int gained = gains[0][h] + gains[1][h] + gains[2][h] + gains[3][h];
+			moves[0][h] -= gained;
+			moves[0][h + 1] += gained;
 		}
+		for (int h = 0; h < SmallHeights; ++h) {
+			long int count = moves[0][h] + moves[1][h] + moves[2][h] + moves[3][h] + moves[4][h];
+			if (count != 0) bins->Add(HeightHistogram<T>::Bin((T)h), count);
 		}
 	}
 
-	return topple;
+	// the heights are written directly, so the running total of the grid is updated here (the
+	// histogram is updated above)
+	boundary_outflow += outflow;
+	sand_grid->AddGrains(-outflow);
 }
 
 /**
- * This is the routine that is used as callback function on a change in the height
- * of an individual cell. It is set in the Sandpile constructor for every cell
- * in the actual grid (but not for the reservoir cell if it exists).
+ * Synchronous relaxation of the BTW model: in every step all unstable cells topple at the
+ * same time, as in a cellular automaton, instead of one after the other. A step reads the
+ * heights from one buffer and writes the new heights to the other, then the buffers change
+ * roles. This goes on till a step without topplings. A step goes over the entire grid in
+ * order, whatever the activity, so it costs about as much as reading and writing the heights
+ * once. That suits global dissipation rather than single avalanches. With more than one
+ * thread (see SetThreads) each lane does a band of rows.
+ *
+ * Every cell topples at most once per step, which is a valid order of topplings, so because
+ * BTW is Abelian the final configuration and the avalanche size (the total number of
+ * topplings) are the same as with the other procedures. A step with topplings counts as a
+ * wave.
  */
-void Toppling::CheckCell(Cell & cell) {
-	switch(toppling_iterator) {
-	case RANDOM_FRACTION:
-	case RANDOM_ALL:
-		break;
-	case FOLLOW_ACTIVITY:
-		if (cell.GetHeight() < topple_threshold)
-			active_cells.erase(&cell);
-		else {
-			active_cells.insert(&cell);
+template <typename T>
+template <BoundaryType B>
+void Toppling<T>::RelaxSynchronous(long int & avalanche_size) {
+	T *heights = sand_grid->GetHeights();
+	long int reservoir = sand_grid->GetReservoir();
+	int height = sand_grid->GetHeight();
+	next_heights.resize(no_cells);
+	quiet_row.assign(width, 0);
+	sweep_from = heights;
+	sweep_to = &next_heights[0];
+
+	bool parallel = (lanes.size() > 1) && (height >= (int)lanes.size());
+	Lane *bands = parallel ? &lanes[0] : &serial_lane;
+	int no_bands = parallel ? lanes.size() : 1;
+	while (true) {
+		if (countDuringAvalanches) noDuringAvalanches->AddEvent(sand_grid->GetGrains());
+		if (parallel) {
+			wave_kernel = &Toppling::template SweepBand<B>;
+			start_barrier->wait();
+			(this->*wave_kernel)(0);
+			done_barrier->wait();
+		} else {
+			Sweep<B>(serial_lane, 0, height);
+		}
+
+		long int topplings = 0;
+		for (int b = 0; b < no_bands; ++b) {
+			Lane & lane = bands[b];
+			topplings += lane.topplings;
+			sand_grid->Increase(reservoir, lane.outflow);
+			if (&lane == &serial_lane) {
+				// unlike the other serial procedures the heights are written directly
+				sand_grid->AddGrains(-(lane.boundary_outflow + lane.bulk_dissipation));
+				if (histogram != NULL) histogram->Merge(lane.histogram);
+			}
+			Settle(lane);
+			lane.outflow = 0;
+			lane.topplings = 0;
+		}
+		if (topplings == 0) break;
+		avalanche_size += topplings;
+		shape.waves++;
+		std::swap(sweep_from, sweep_to);
+	}
+
+	// after a step without topplings both buffers are the same
+	if (sweep_from != heights) std::copy(sweep_from, sweep_from + no_cells, heights);
+}
+
+/**
+ * A cell only reads its own height and those of its neighbours in sweep_from and only writes
+ * its own height in sweep_to, so any division of the rows is fine. The loop over the inner
+ * columns of a row has no branches and no indirections, so the compiler turns it into vector
+ * instructions (SSE2, or AVX2 with -mavx2). The first and last column are done apart, just
+ * as the rows outside the grid: the neighbours on the other side with periodic boundaries,
+ * or empty cells (quiet_row) otherwise. A cell at the border of a dissipating grid gives the
+ * grains for its missing neighbours to the reservoir.
+ */
+template <typename T>
+template <BoundaryType B>
+void Toppling<T>::Sweep(Lane & lane, int first_row, int end_row) {
+	const int height = sand_grid->GetHeight();
+	const long int last = width - 1;
+	const T threshold = topple_threshold;
+	const T decrease = (diss_amount <= 0) ? 4 : (T)diss_amount;
+	const T increase = decrease / 4;
+	const T *quiet = &quiet_row[0];
+	long int topplings = 0, sides = 0;
+	for (int j = first_row; j < end_row; ++j) {
+		const T *row = sweep_from + j * width;
+		const T *up = (j > 0) ? row - width :
+				((B == BT_PERIODIC) ? sweep_from + (height - 1) * width : quiet);
+		const T *down = (j < height - 1) ? row + width : ((B == BT_PERIODIC) ? sweep_from : quiet);
+		T * __restrict__ out = sweep_to + j * width;
+
+		int toppled = 0;
+		for (long int c = 1; c < last; ++c) {
+			out[c] = Step(row[c], up[c], down[c], row[c-1], row[c+1], threshold, decrease,
+					increase);
+			toppled += (row[c] >= threshold);
+		}
+		T outside = (B == BT_PERIODIC) ? row[last] : quiet[0];
+		out[0] = Step(row[0], up[0], down[0], outside, (last > 0) ? row[1] : outside, threshold,
+				decrease, increase);
+		toppled += (row[0] >= threshold);
+		if (last > 0) {
+			outside = (B == BT_PERIODIC) ? row[0] : quiet[0];
+			out[last] = Step(row[last], up[last], down[last], row[last-1], outside, threshold,
+					decrease, increase);
+			toppled += (row[last] >= threshold);
+		}
+		if (toppled == 0) continue;
+
+		topplings += toppled;
+		if (B != BT_PERIODIC) {
+			sides += (row[0] >= threshold) + (row[last] >= threshold);
+			if (j == 0) sides += toppled;
+			if (j == height - 1) sides += toppled;
+		}
+		for (long int c = 0; c <= last; ++c) {
+			if (row[c] >= threshold) Visit(j * width + c, lane);
 		}
-		break;
 	}
+
+	// a cell only changes if it or one of its neighbours toppled, but that is not known here
+	if (histogram != NULL) {
+		for (long int n = first_row * width; n < end_row * width; ++n) {
+			if (sweep_to[n] != sweep_from[n]) lane.histogram.Move(sweep_from[n], sweep_to[n]);
+		}
+	}
+
+	lane.topplings += topplings;
+	lane.outflow += sides * increase;
+	lane.boundary_outflow += sides * (GrainType)increase;
+	lane.bulk_dissipation += topplings * ((GrainType)decrease - 4 * (GrainType)increase);
+}
+
+/**
+ * The rows are divided in bands as evenly as possible, band l is for lane l.
+ */
+template <typename T>
+template <BoundaryType B>
+void Toppling<T>::SweepBand(int l) {
+	int height = sand_grid->GetHeight();
+	int no_lanes = lanes.size();
+	Sweep<B>(lanes[l], (long int)l * height / no_lanes, (long int)(l + 1) * height / no_lanes);
 }
 
 /**
@@ -390,88 +789,535 @@ void Toppling::CheckCell(Cell & cell) {
  * things up. We just iterate over the entire sand_grid and call Topple for every
  * sand_grid cell. If none of the cells topples, we are done. If they keep toppling
  * then we end up in an infinite loop.
+ *
+ * The neighbours are obtained for boundary type B, where BT_UNDEFINED stands for all
+ * boundary types that use the neighbour table. The iterator I is fixed at compile time
+ * as well.
  */
-void Toppling::Topple(long int & avalanche_size) {
-	vector<Cell*> neighbours;
+template <typename T>
+template <TopplingMethod M, BoundaryType B, TopplingIterator I>
+void Toppling<T>::Relax(long int & avalanche_size) {
+	const long int *neighbours;
+	long int scratch[4];
+	int no_neighbours;
 	bool quit;
-	avalanche_size = 0;
 	int it_n = 0;
 
 	// RANDOM_ALL: go over entire grid L*L
-	int iterate_number = sand_grid->GetWidth() * sand_grid->GetHeight();
+	// RANDOM_FRACTION: only L items (so we do not accidently introduce a factor depending on
+	// the system size)
+	long int iterate_number = (I == RANDOM_FRACTION) ? sand_grid->GetWidth() : no_cells;
 	do {
-		quit = true;
-		switch(toppling_iterator) {
-		case RANDOM_FRACTION:
-			// Only L items (so we do not accidently introduce a factor depending on the system size)
-			iterate_number = (float)sand_grid->GetWidth();
-		case RANDOM_ALL:
-			std::random_shuffle(random_indices, random_indices+sand_grid->GetWidth()*sand_grid->GetHeight(), p_boost_random);
-
-			for (int c = 0; c < iterate_number; ++c) {
-				int cell_index = random_indices[c];
-				int i = cell_index % sand_grid->GetWidth();
-				int j = cell_index / sand_grid->GetWidth();
-				neighbours.clear();
-				sand_grid->GetNeighbours(i, j, neighbours);
-				if (Topple(sand_grid->GetCell(i,j), neighbours)) {
-					avalanche_size++;
-					quit = false;
-				}
-			}
-			break;
-		case FOLLOW_ACTIVITY:
-			// active cells have to be in a different order each time, so hence we use a vector here
-			// then we shuffle it randomly using the boost random generator
-			// and we clear active_cells, this has also the advantage that we can use active_cells
-			// within this for-loop, while elseway the iterator might become corrupted
-			vector<long int> c_indices; c_indices.clear();
-			set<Cell*>::iterator it;
-			for (it = active_cells.begin(); it != active_cells.end(); ++it) {
-				c_indices.push_back((*it)->GetId());
-			}
-			std::random_shuffle(c_indices.begin(), c_indices.end(), p_boost_random);
-			active_cells.clear();
+		long int size_before = avalanche_size;
+		if (I == FOLLOW_ACTIVITY) {
+			// the random words of a toppling belong to the cell, so the order within a wave
+			// does not matter (except for rounding with real heights) and it is not shuffled
+			// NextWave also clears active_cells, and the wave is a separate buffer, so we can
+			// insert into active_cells within this for-loop
+			vector<long int> & c_indices = active_cells.NextWave();
 
 			if (countDuringAvalanches && !it_n) {
-				long int n = sand_grid->CountGrains();
+				long int n = sand_grid->GetGrains();
 				noDuringAvalanches->AddEvent(n);
 			}
 
-			for (unsigned int c = 0; c < c_indices.size(); ++c) {
-				neighbours.clear();
-				int cell_index = c_indices[c];
-				int i = cell_index % sand_grid->GetWidth();
-				int j = cell_index / sand_grid->GetWidth();
-				sand_grid->GetNeighbours(i, j, neighbours);
+			if (parallel_waves && ((long int)c_indices.size() >= min_parallel_wave)) {
+				ToppleWave<M, B>(c_indices, avalanche_size);
+			} else {
+				if (!c_indices.empty()) FillRandom<M>(&c_indices[0], c_indices.size(), serial_lane);
+				for (unsigned int c = 0; c < c_indices.size(); ++c) {
+					long int cell_index = c_indices[c];
+					no_neighbours = sand_grid->template GetNeighbours<B>(cell_index, neighbours,
+							scratch);
 
-				if (Topple(sand_grid->GetCell(i, j), neighbours)) {
-					avalanche_size++;
+					if (serial_lane.stride) serial_lane.words = &serial_lane.random[c];
+					if (Topple<M, I, ROUTE_SERIAL>(cell_index, neighbours, no_neighbours, serial_lane)) {
+						avalanche_size++;
+					}
 				}
+				serial_lane.words = NULL;
 			}
 
 			// count number of grains, not really "nicely defined" because the way activity diffusion
 			// is implemented influences the number of loops for Topple...
 			if (countDuringAvalanches) {
-				long int n = sand_grid->CountGrains(); // / sand_grid->GetHeight(); // * sand_grid->GetWidth());
+				long int n = sand_grid->GetGrains(); // / sand_grid->GetHeight(); // * sand_grid->GetWidth());
 //				cout << "Number of grains: " << n << endl;
 				noDuringAvalanches->AddEvent(n);
 			}
 
-			quit = active_cells.empty();
-			break;
+			quit = active_cells.Empty();
+		} else {
+			quit = true;
+			RandomIndex random_cell(context->GetGenerator(FT_GRID));
+			std::random_shuffle(random_indices, random_indices+no_cells, random_cell);
+
+			for (int c = 0; c < iterate_number; ++c) {
+				int cell_index = random_indices[c];
+				no_neighbours = sand_grid->template GetNeighbours<B>(cell_index, neighbours, scratch);
+				if (Topple<M, I, ROUTE_SERIAL>(cell_index, neighbours, no_neighbours, serial_lane)) {
+					avalanche_size++;
+					quit = false;
+				}
+			}
 		}
 		++it_n;
+		if (avalanche_size > size_before) shape.waves++;
 
 	} while (!quit);
+}
+
+/**
+ * Within a wave every cell topples exactly once, whatever the order, because only its own
+ * toppling decreases its height. So a wave can be divided over threads, as long as two
+ * threads never change the same cell at the same time. The grid is cut in an even number of
+ * stripes of at least two rows, coloured alternately. A cell only changes its own row and
+ * the rows above and below it, so stripes of the same colour can be toppled at the same time.
+ * This is done in two sub-waves, one per colour. The active cells and the reservoir are only
+ * updated afterwards, by the calling thread, from what the lanes collected.
+ *
+ * For BTW the result is exactly the same as that of the serial procedure. For the stochastic
+ * models the random numbers belong to the cells, see FillRandom, so with integer heights the
+ * result is exactly the same as well.
+ */
+template <typename T>
+template <TopplingMethod M, BoundaryType B>
+void Toppling<T>::ToppleWave(vector<long int> & wave, long int & avalanche_size) {
+	int i, j;
+	for (unsigned int s = 0; s < stripes.size(); ++s) stripes[s].clear();
+	for (unsigned int c = 0; c < wave.size(); ++c) {
+		sand_grid->GetCoordinates(wave[c], i, j);
+		stripes[stripe_of_row[j]].push_back(wave[c]);
+	}
+
+	wave_kernel = &Toppling::template ToppleStripes<M, B>;
+	for (wave_colour = 0; wave_colour < 2; ++wave_colour) {
+		start_barrier->wait();
+		(this->*wave_kernel)(0);
+		done_barrier->wait();
+	}
+
+	long int reservoir = sand_grid->GetReservoir();
+	for (unsigned int l = 0; l < lanes.size(); ++l) {
+		Lane & lane = lanes[l];
+		avalanche_size += lane.topplings;
+		sand_grid->Increase(reservoir, lane.outflow);
+		Settle(lane);
+		for (unsigned int c = 0; c < lane.unstable.size(); ++c) {
+			Activate<FOLLOW_ACTIVITY>(lane.unstable[c]);
+		}
+		lane.unstable.clear();
+		lane.outflow = 0;
+		lane.topplings = 0;
+	}
+}
+
+/**
+ * Every lane has its own band of stripes, about the same band of rows as its tile (see
+ * SetThreads), and topples the ones of the current colour in it. With the first touch of
+ * the grid per band (see GridAllocator) the lane then works on pages of its own node.
+ */
+template <typename T>
+template <TopplingMethod M, BoundaryType B>
+void Toppling<T>::ToppleStripes(int l) {
+	Lane & lane = lanes[l];
+	const long int *neighbours;
+	long int scratch[4];
+	long int no_stripes = stripes.size(), no_lanes = lanes.size();
+	long int first = (l * no_stripes + no_lanes - 1) / no_lanes;
+	long int end = ((l + 1) * no_stripes + no_lanes - 1) / no_lanes;
+	for (long int s = first + ((first + wave_colour) & 1); s < end; s += 2) {
+		vector<long int> & cells = stripes[s];
+		if (cells.empty()) continue;
+		FillRandom<M>(&cells[0], cells.size(), lane);
+		for (unsigned int c = 0; c < cells.size(); ++c) {
+			int no_neighbours = sand_grid->template GetNeighbours<B>(cells[c], neighbours,
+					scratch);
+			if (lane.stride) lane.words = &lane.random[c];
+			if (Topple<M, FOLLOW_ACTIVITY, ROUTE_WAVE>(cells[c], neighbours, no_neighbours, lane)) {
+				lane.topplings++;
+			}
+		}
+		lane.words = NULL;
+	}
+}
+
+/**
+ * The serial procedure changes the heights through the grid, which keeps its running total
+ * up to date itself. The other lanes write the heights directly, so the grains that left the
+ * grid are taken off the running total here. What moved between cells does not change it.
+ * Their changes to the height histogram are merged into the one of the grid.
+ */
+template <typename T>
+void Toppling<T>::Settle(Lane & lane) {
+	boundary_outflow += lane.boundary_outflow;
+	bulk_dissipation += lane.bulk_dissipation;
+	extent.Merge(lane.extent);
+	if (&lane != &serial_lane) {
+		sand_grid->AddGrains(-(lane.boundary_outflow + lane.bulk_dissipation));
+		if (histogram != NULL) histogram->Merge(lane.histogram);
+	}
+	lane.boundary_outflow = 0;
+	lane.bulk_dissipation = 0;
+}
+
+/**
+ * Decomposition of the grid in tiles: every thread owns a band of rows and relaxes it on its
+ * own. Grains that go to a cell in another tile are kept in the halo rows of the lane. When
+ * all tiles are stable, the tiles exchange their halo rows: each tile takes the grains for
+ * its first row from the tile above and for its last row from the tile below. This is
+ * repeated till all tiles are stable after an exchange.
+ *
+ * A cell topples once each time it is taken from the list of unstable cells, and this list
+ * is a stack, not a wave. The avalanche size is the total number of topplings, just as with
+ * the serial procedure. For BTW it is exactly the same number, because the model is Abelian.
+ */
+template <typename T>
+template <TopplingMethod M, BoundaryType B>
+void Toppling<T>::RelaxTiles(long int & avalanche_size) {
+	int width = sand_grid->GetWidth();
+	vector<long int> & wave = active_cells.NextWave();
+	for (unsigned int c = 0; c < wave.size(); ++c) {
+		lanes[tile_of_row[wave[c] / width]].unstable.push_back(wave[c]);
+	}
+
+	wave_kernel = &Toppling::template RelaxTile<M, B>;
+	start_barrier->wait();
+	(this->*wave_kernel)(0);
+	done_barrier->wait();
+
+	long int reservoir = sand_grid->GetReservoir();
+	for (unsigned int l = 0; l < lanes.size(); ++l) {
+		avalanche_size += lanes[l].topplings;
+		sand_grid->Increase(reservoir, lanes[l].outflow);
+		Settle(lanes[l]);
+		lanes[l].outflow = 0;
+		lanes[l].topplings = 0;
+	}
+}
+
+/**
+ * The busy flag of a tile is written between the two barriers of an exchange, and read by all
+ * lanes after the second one. It is not written again before every lane passed the first
+ * barrier of the next round, so one flag per tile is enough.
+ */
+template <typename T>
+template <TopplingMethod M, BoundaryType B>
+void Toppling<T>::RelaxTile(int l) {
+	Lane & lane = lanes[l];
+	int no_lanes = lanes.size();
+	Lane & above = lanes[(l + no_lanes - 1) % no_lanes];
+	Lane & below = lanes[(l + 1) % no_lanes];
+	int width = sand_grid->GetWidth();
+	const long int *neighbours;
+	long int scratch[4];
+	while (true) {
+		while (!lane.unstable.empty()) {
+			long int index = lane.unstable.back();
+			lane.unstable.pop_back();
+			int no_neighbours = sand_grid->template GetNeighbours<B>(index, neighbours, scratch);
+			if (Topple<M, FOLLOW_ACTIVITY, ROUTE_TILE>(index, neighbours, no_neighbours, lane)) {
+				lane.topplings++;
+			}
+		}
+		tile_barrier->wait();
+
+		// the row below the tile above is the first row of this tile, and vice versa
+		Absorb(lane, above, 1, lane.begin);
+		Absorb(lane, below, 0, lane.end - width);
+		busy_tiles[l] = !lane.unstable.empty();
+		tile_barrier->wait();
+
+		bool busy = false;
+		for (int t = 0; t < no_lanes; ++t) busy = busy || busy_tiles[t];
+		if (!busy) break;
+	}
+}
+
+/**
+ * Only the lane that owns the row reads and clears the halo row of the other lane.
+ */
+template <typename T>
+void Toppling<T>::Absorb(Lane & lane, Lane & from, int h, long int row_begin) {
+	T *heights = sand_grid->GetHeights();
+	vector<int> & columns = from.halo_columns[h];
+	for (unsigned int c = 0; c < columns.size(); ++c) {
+		long int index = row_begin + columns[c];
+		T before = heights[index];
+		bool stable = (before < topple_threshold);
+		heights[index] += from.halo[h][columns[c]];
+		if (histogram != NULL) lane.histogram.Move(before, heights[index]);
+		from.halo[h][columns[c]] = 0;
+		if (stable && (heights[index] >= topple_threshold)) lane.unstable.push_back(index);
+	}
+	columns.clear();
+}
+
+/**
+ * A worker thread waits for the start of a sub-wave, topples its stripes and waits till the
+ * other threads are done as well. If the grid is first touched in a band per thread, the
+ * worker runs on the CPUs that touched its band, see GridAllocator::Pin. The calling thread
+ * is the first lane, it is not pinned.
+ */
+template <typename T>
+void Toppling<T>::Work(int l) {
+	if (sand_grid->GetBands() == (int)lanes.size()) GridAllocator::Pin(l, lanes.size());
+	while (true) {
+		start_barrier->wait();
+		if (stop_workers) return;
+		(this->*wave_kernel)(l);
+		done_barrier->wait();
+	}
+}
+
+/**
+ * Start the worker threads, the calling thread is the first lane. Every lane has its own
+ * generator, seeded by the toppling feed and the number of the lane. Every lane has a band of
+ * about eight stripes, four of each colour, in the same rows as its tile. Smaller waves than
+ * min_wave are not worth waking up the threads for.
+ */
+template <typename T>
+void Toppling<T>::SetThreads(int no_threads, long int min_wave) {
+	StopWorkers();
+	if (no_threads < 1) no_threads = 1;
+	min_parallel_wave = min_wave;
+	lanes.resize(no_threads);
+	for (int l = 0; l < no_threads; ++l) {
+		lanes[l].own_generator.seed(context->Seed(context->GetFeed(FT_TOPPLING) + l));
+		lanes[l].generator = &lanes[l].own_generator;
+		lanes[l].outflow = 0;
+		lanes[l].boundary_outflow = 0;
+		lanes[l].bulk_dissipation = 0;
+		lanes[l].topplings = 0;
+		lanes[l].extent.Clear();
+		lanes[l].words = NULL;
+		lanes[l].stride = 0;
+	}
+
+	// bands of rows for the tiled mode, of at least two rows
+	int width = sand_grid->GetWidth();
+	int height = sand_grid->GetHeight();
+	tile_of_row.clear();
+	busy_tiles.assign(no_threads, 0);
+	if ((no_threads > 1) && (height >= 2 * no_threads)) {
+		for (int j = 0; j < height; ++j) {
+			tile_of_row.push_back((int)((long int)j * no_threads / height));
+		}
+		for (int l = 0; l < no_threads; ++l) {
+			Lane & lane = lanes[l];
+			long int first_row = ((long int)l * height + no_threads - 1) / no_threads;
+			long int last_row = ((long int)(l + 1) * height + no_threads - 1) / no_threads - 1;
+			lane.begin = first_row * width;
+			lane.end = (last_row + 1) * width;
+			lane.halo_begin[0] = ((first_row + height - 1) % height) * width;
+			lane.halo_begin[1] = ((last_row + 1) % height) * width;
+			for (int h = 0; h < 2; ++h) {
+				lane.halo[h].assign(width, 0);
+				lane.halo_columns[h].clear();
+			}
+		}
+	}
+
+	int no_stripes = std::min(8 * no_threads, height / 2);
+	no_stripes -= no_stripes % 2;
+	stripes.clear();
+	stripe_of_row.clear();
+	if (no_stripes >= 2) {
+		stripes.resize(no_stripes);
+		for (int j = 0; j < height; ++j) {
+			stripe_of_row.push_back((int)((long int)j * no_stripes / height));
+		}
+	}
+
+	if (no_threads > 1) {
+		workers = new boost::thread_group();
+		start_barrier = new boost::barrier(no_threads);
+		done_barrier = new boost::barrier(no_threads);
+		tile_barrier = new boost::barrier(no_threads);
+		for (int l = 1; l < no_threads; ++l) {
+			workers->create_thread(boost::bind(&Toppling::Work, this, l));
+		}
+	}
+	select_kernel = true;
+}
+
+/**
+ * Let the workers return from Work and wait for them.
+ */
+template <typename T>
+void Toppling<T>::StopWorkers() {
+	if (start_barrier == NULL) return;
+	stop_workers = true;
+	start_barrier->wait();
+	workers->join_all();
+	delete workers;
+	delete start_barrier;
+	delete done_barrier;
+	delete tile_barrier;
+	workers = NULL;
+	start_barrier = done_barrier = tile_barrier = NULL;
+	stop_workers = false;
+}
+
+/**
+ * Run the kernel that fits the current settings, see SelectKernel.
+ */
+template <typename T>
+void Toppling<T>::Topple(long int & avalanche_size) {
+	avalanche_size = 0;
+	shape.waves = 0;
+	if (++epoch == 0) {
+		std::fill(visited.begin(), visited.end(), 0);
+		epoch = 1;
+	}
+	histogram = sand_grid->GetHistogram();
+	if (select_kernel) SelectKernel();
+	(this->*kernel)(avalanche_size);
+	Settle(serial_lane);
+	SetShape(avalanche_size);
 
 #ifdef EXTRA_ORDINARY_CHECKING
 	// after all toppling, every cell should be below topple_threshold
 	for (int i = 0; i < sand_grid->GetWidth(); ++i) {
 		for (int j = 0; j < sand_grid->GetHeight(); ++j) {
-			int h = sand_grid->GetCell(i,j).GetHeight();
+			T h = sand_grid->GetCell(i,j).GetHeight();
 			assert (h < topple_threshold);
 		}
 	}
 #endif
 }
+
+/**
+ * Pick the kernel for the current toppling method, boundary type and iterator. This is
+ * done on the first call to Topple after one of these settings changed. Only the periodic,
+ * dissipating and fully connected boundaries have their own kernels, the other ones use
+ * the neighbour table. Waves can only be toppled in parallel if all neighbours of a cell
+ * are in the rows next to it, hence not with random neighbours. If the tiles are used, they
+ * are used for BTW as well.
+ */
+template <typename T>
+void Toppling<T>::SelectKernel() {
+	BoundaryType boundary_type = sand_grid->GetBoundaryType();
+	switch (boundary_type) {
+	case BT_PERIODIC: case BT_DISSIPATING: case BT_WALL_DISSIPATING: case BT_CIRCULAR:
+		parallel_waves = (lanes.size() > 1) && !stripes.empty() &&
+				(toppling_method != Rossum2011_diss);
+		break;
+	default:
+		// neighbours are not in the rows above and below
+		parallel_waves = false;
+		break;
+	}
+	if (IsAbelian() && !UseTiles()) {
+		switch (boundary_type) {
+		case BT_PERIODIC:
+			kernel = &Toppling::template ToppleAbelian<BT_PERIODIC>;
+			break;
+		case BT_DISSIPATING:
+			kernel = &Toppling::template ToppleAbelian<BT_DISSIPATING>;
+			break;
+		default:
+			kernel = &Toppling::template ToppleAbelian<BT_UNDEFINED>;
+			break;
+		}
+	} else {
+		switch (toppling_method) {
+		case Manna_Lin2010:
+			kernel = SelectBoundary<Manna_Lin2010>(boundary_type);
+			break;
+		case Bak_Tang_Wiesenfeld1987:
+			kernel = SelectBoundary<Bak_Tang_Wiesenfeld1987>(boundary_type);
+			break;
+		case Lin_etal2006:
+			kernel = SelectBoundary<Lin_etal2006>(boundary_type);
+			break;
+		case Rossum2011:
+			kernel = SelectBoundary<Rossum2011>(boundary_type);
+			break;
+		case Rossum2011_diss:
+			kernel = SelectBoundary<Rossum2011_diss>(boundary_type);
+			break;
+		case TM_UNDEFINED:
+			cerr << "Undefined toppling method" << endl;
+			assert(false);
+			break;
+		}
+	}
+	select_kernel = false;
+}
+
+/**
+ * The tiles are only used if asked for, and if there are enough threads and rows. Counting
+ * during avalanches and counting the waves need waves, so that is not possible with tiles.
+ * A tile is a range of indices, so the cells have to be stored row by row.
+ */
+template <typename T>
+bool Toppling<T>::UseTiles() {
+	if (!tiled || tile_of_row.empty()) return false;
+	if (toppling_iterator != FOLLOW_ACTIVITY) return false;
+	if (countDuringAvalanches || measure_waves) return false;
+	if (toppling_method == Rossum2011_diss) return false;
+	if (sand_grid->GetLayout() != GL_ROW_MAJOR) return false;
+	BoundaryType boundary_type = sand_grid->GetBoundaryType();
+	return (boundary_type == BT_PERIODIC) || (boundary_type == BT_DISSIPATING);
+}
+
+/**
+ * Pick the kernel for method M given the boundary type, or the tiles, see UseTiles.
+ */
+template <typename T>
+template <TopplingMethod M>
+typename Toppling<T>::Kernel Toppling<T>::SelectBoundary(BoundaryType boundary_type) {
+	if (UseTiles()) {
+		if (boundary_type == BT_PERIODIC) return &Toppling::template RelaxTiles<M, BT_PERIODIC>;
+		return &Toppling::template RelaxTiles<M, BT_DISSIPATING>;
+	}
+	switch (boundary_type) {
+	case BT_PERIODIC:
+		return SelectIterator<M, BT_PERIODIC>();
+	case BT_DISSIPATING:
+		return SelectIterator<M, BT_DISSIPATING>();
+	case BT_FULLY_CONNECTED:
+		return SelectIterator<M, BT_FULLY_CONNECTED>();
+	default:
+		return SelectIterator<M, BT_UNDEFINED>();
+	}
+}
+
+/**
+ * Pick the kernel for method M and boundary type B given the iterator.
+ */
+template <typename T>
+template <TopplingMethod M, BoundaryType B>
+typename Toppling<T>::Kernel Toppling<T>::SelectIterator() {
+	switch (toppling_iterator) {
+	case RANDOM_ALL:
+		return &Toppling::template Relax<M, B, RANDOM_ALL>;
+	case RANDOM_FRACTION:
+		return &Toppling::template Relax<M, B, RANDOM_FRACTION>;
+	case SYNCHRONOUS:
+		if ((M == Bak_Tang_Wiesenfeld1987) && ((B == BT_PERIODIC) || (B == BT_DISSIPATING)) &&
+				(sand_grid->GetLayout() == GL_ROW_MAJOR))
+			return &Toppling::template RelaxSynchronous<B>;
+		cerr << "Warning: synchronous toppling is only for BTW on periodic or dissipating " <<
+				"boundaries with the cells row by row, the cells topple in random order " <<
+				"instead" << endl;
+		if (random_indices == NULL) {
+			random_indices = new int[no_cells];
+			for (int i = 0; i < no_cells; i++) random_indices[i] = i;
+		}
+		return &Toppling::template Relax<M, B, RANDOM_ALL>;
+	case FOLLOW_ACTIVITY:
+	default:
+		return &Toppling::template Relax<M, B, FOLLOW_ACTIVITY>;
+	}
+}
+
+/* **************************************************************************************
+ * Explicit instantiations of Toppling
+ * **************************************************************************************/
+
+template class Toppling<uint8_t>;
+template class Toppling<int32_t>;
+template class Toppling<float>;
+template class Toppling<double>;
@@ -0,0 +1,374 @@
+/**
+ * @file TestAbelian.cpp
+ * @brief
+ *
+ * This file is created at Almende B.V. It is open-source software and part of the Common
+ * Hybrid Agent Platform (CHAP). A toolbox with a lot of open-source tools, ranging from
+ * thread pools and TCP/IP components to control architectures and learning algorithms.
+ * This software is published under the GNU Lesser General Public license (LGPL).
+ *
+ * It is not possible to add usage restrictions to an open-source license. Nevertheless,
+ * we personally strongly object against this software used by the military, in the
+ * bio-industry, for animal experimentation, or anything that violates the Universal
+ * Declaration of Human Rights.
+ *
+ * Copyright © 2010 Anne van Rossum <anne@almende.com>
+ *
+ * @author 	Anne C. van Rossum
+ * @date	Oct 16, 2026
+ * @project	Replicator FP7
+ * @company	Almende B.V.
+ * @case	Self-organised criticality
+ */
+
+#include <Grid.h>
+#include <Toppling.h>
+#include <PackedLattice.h>
+#include <ReplicaLattice.h>
+
+#include <iostream>
+#include <cmath>
+#include <map>
+#include <stdlib.h>
+
+/* **************************************************************************************
+ * Test of the dedicated BTW relaxation against the general toppling procedure
+ * **************************************************************************************/
+
+using namespace std;
+
+/**
+ * Drop grains on the same random spots of five grids. On the first grid the dedicated
+ * relaxation for BTW is used, on the others the general procedure with waves, on the third
+ * one with the waves divided over several threads, on the fourth one with a tile per thread
+ * (periodic and dissipating boundaries only). On the last one BTW topples synchronously,
+ * with the rows divided over several threads. The avalanche sizes and the heights should be
+ * exactly the same after every grain.
+ *
+ * The stochastic Manna model with integer heights should be the same as well, because the
+ * random numbers of a toppling belong to the cell, not to the thread that topples it. There
+ * the first grid uses the general procedure too.
+ *
+ * All grids have the same layout. With the cells in tiles the procedures that need the cells
+ * row by row (a tile per thread, synchronous steps) are replaced by the general procedure.
+ *
+ * The first grid keeps a histogram of the heights, at the end it is compared with a count of
+ * the heights themselves.
+ */
+template <typename T>
+bool Compare(int L, BoundaryType boundary_type, long int timespan,
+		TopplingMethod method = Bak_Tang_Wiesenfeld1987, GridLayout layout = GL_ROW_MAJOR) {
+	const int G = 5;
+	Grid<T> *grid[G];
+	Toppling<T> *toppling[G];
+	SimulationContext context[G];
+	for (int g = 0; g < G; ++g) {
+		grid[g] = new Grid<T>(L, L, boundary_type, context[g], layout);
+		toppling[g] = new Toppling<T>(grid[g]);
+		toppling[g]->SetTopplingMethod(method);
+		toppling[g]->SetTopplingIterator(FOLLOW_ACTIVITY);
+		toppling[g]->SetDissipationAmount(-1);
+		toppling[g]->SetAbelian(g == 0);
+	}
+	grid[0]->SetHistogram(true);
+	toppling[2]->SetThreads(2, 8);
+	toppling[3]->SetThreads(2);
+	toppling[3]->SetTiled(true);
+	if (method == Bak_Tang_Wiesenfeld1987) toppling[4]->SetTopplingIterator(SYNCHRONOUS);
+	toppling[4]->SetThreads(2);
+	assert (toppling[0]->IsAbelian() == (method == Bak_Tang_Wiesenfeld1987));
+	assert (!toppling[1]->IsAbelian());
+
+	srand(238904);
+	bool success = true;
+	long int total = 0;
+	for (long int t = 0; (t < timespan) && success; ++t) {
+		int n = rand() % (L*L);
+		long int avalanche_size[G];
+		for (int g = 0; g < G; ++g) {
+			grid[g]->Increase(n, 1);
+			toppling[g]->CheckCell(n);
+			toppling[g]->Topple(avalanche_size[g]);
+		}
+		total += avalanche_size[0];
+		for (int g = 1; g < G; ++g) {
+			if (avalanche_size[0] != avalanche_size[g]) {
+				cerr << "Avalanche " << t << " differs on grid " << g << ": "
+						<< avalanche_size[0] << " != " << avalanche_size[g] << endl;
+				success = false;
+			}
+		}
+	}
+	for (int g = 1; g < G; ++g) {
+		for (long int n = 0; (n <= grid[0]->GetSize()) && success; ++n) {
+			if (grid[0]->GetHeights()[n] != grid[g]->GetHeights()[n]) {
+				cerr << "Height of cell " << n << " differs on grid " << g << endl;
+				success = false;
+			}
+		}
+	}
+	std::map<long int, long int> counts;
+	for (long int n = 0; n < grid[0]->GetSize(); ++n) {
+		counts[HeightHistogram<T>::Bin(grid[0]->GetHeights()[n])]++;
+	}
+	HeightHistogram<T> *bins = grid[0]->GetHistogram();
+	long int counted = 0;
+	for (long int bin = bins->Begin(); bin < bins->End(); ++bin) {
+		counted += bins->Count(bin);
+		if (success && (bins->Count(bin) != counts[bin])) {
+			cerr << "Histogram of bin " << bin << " differs: " << bins->Count(bin) << " != "
+					<< counts[bin] << endl;
+			success = false;
+		}
+	}
+	if (success && (counted != grid[0]->GetSize())) {
+		cerr << "Histogram counts " << counted << " cells instead of " << grid[0]->GetSize() << endl;
+		success = false;
+	}
+	cout << method << ", boundary " << boundary_type << ", " << layout << ": " << total << " topplings in total, "
+			<< (success ? "same" : "different") << endl;
+
+	for (int g = 0; g < G; ++g) {
+		delete toppling[g];
+		delete grid[g];
+	}
+	return success;
+}
+
+/**
+ * The same as Compare, but with the radius and the bounding box measured (SetMeasureExtent),
+ * as when these figures are plotted. That should not rule out the dedicated relaxation for
+ * BTW or the tiles, only counting the waves does. A cell belongs to the avalanche however
+ * often and in whatever order it topples, so the area, radius and box are the same as well.
+ */
+bool CompareShape(int L, BoundaryType boundary_type, long int timespan) {
+	const int G = 3;
+	Grid<int32_t> *grid[G];
+	Toppling<int32_t> *toppling[G];
+	SimulationContext context[G];
+	for (int g = 0; g < G; ++g) {
+		grid[g] = new Grid<int32_t>(L, L, boundary_type, context[g]);
+		toppling[g] = new Toppling<int32_t>(grid[g]);
+		toppling[g]->SetTopplingMethod(Bak_Tang_Wiesenfeld1987);
+		toppling[g]->SetTopplingIterator(FOLLOW_ACTIVITY);
+		toppling[g]->SetDissipationAmount(-1);
+		toppling[g]->SetAbelian(g == 0);
+		toppling[g]->SetMeasureExtent(true);
+	}
+	toppling[2]->SetThreads(2);
+	toppling[2]->SetTiled(true);
+	assert (toppling[0]->IsAbelian());
+
+	srand(238904);
+	bool success = true;
+	long int total = 0;
+	for (long int t = 0; (t < timespan) && success; ++t) {
+		int n = rand() % (L*L);
+		AvalancheShape shape[G];
+		for (int g = 0; g < G; ++g) {
+			long int avalanche_size;
+			grid[g]->Increase(n, 1);
+			toppling[g]->CheckCell(n);
+			toppling[g]->Topple(avalanche_size);
+			shape[g] = toppling[g]->GetShape();
+		}
+		total += shape[0].area;
+		for (int g = 1; g < G; ++g) {
+			if ((shape[0].size != shape[g].size) || (shape[0].area != shape[g].area) ||
+					(shape[0].left != shape[g].left) || (shape[0].right != shape[g].right) ||
+					(shape[0].top != shape[g].top) || (shape[0].bottom != shape[g].bottom) ||
+					(fabs(shape[0].radius - shape[g].radius) > 1e-9)) {
+				cerr << "Shape of avalanche " << t << " differs on grid " << g << endl;
+				success = false;
+			}
+		}
+	}
+	cout << "Shape, boundary " << boundary_type << ": " << total << " cells in total, "
+			<< (success ? "same" : "different") << endl;
+
+	for (int g = 0; g < G; ++g) {
+		delete toppling[g];
+		delete grid[g];
+	}
+	return success;
+}
+
+/**
+ * A grid on normal pages and a grid on huge pages that is touched first in three bands of
+ * rows should have the same neighbours and directions. Then grains are dropped on the same
+ * random spots of both, with the dedicated BTW relaxation, and the heights should be the
+ * same as well. The grids are large enough for the neighbour table to be on huge pages.
+ */
+bool CompareAllocation(int L, BoundaryType boundary_type, GridLayout layout,
+		PageType page_type) {
+	const int G = 2;
+	Grid<int32_t> *grid[G];
+	Toppling<int32_t> *toppling[G];
+	SimulationContext context[G];
+	for (int g = 0; g < G; ++g) {
+		GridAllocator allocator(g ? page_type : PT_NORMAL, g ? 3 : 1);
+		grid[g] = new Grid<int32_t>(L, L, boundary_type, context[g], layout, allocator);
+		toppling[g] = new Toppling<int32_t>(grid[g]);
+		toppling[g]->SetTopplingMethod(Bak_Tang_Wiesenfeld1987);
+		toppling[g]->SetTopplingIterator(FOLLOW_ACTIVITY);
+		toppling[g]->SetDissipationAmount(-1);
+	}
+
+	bool success = true;
+	const long int *neighbours[G];
+	for (long int n = 0; (n < grid[0]->GetSize()) && success; ++n) {
+		int no_neighbours = grid[0]->GetNeighbours(n, neighbours[0]);
+		success = (no_neighbours == grid[1]->GetNeighbours(n, neighbours[1])) &&
+				std::equal(neighbours[0], neighbours[0] + no_neighbours, neighbours[1]) &&
+				(grid[0]->GetDirections()[n] == grid[1]->GetDirections()[n]);
+	}
+
+	srand(238904);
+	long int total = 0;
+	for (long int t = 0; (t < 2*L*L) && success; ++t) {
+		int n = rand() % (L*L);
+		long int avalanche_size[G];
+		for (int g = 0; g < G; ++g) {
+			grid[g]->Increase(n, 1);
+			toppling[g]->CheckCell(n);
+			toppling[g]->Topple(avalanche_size[g]);
+		}
+		total += avalanche_size[0];
+		success = (avalanche_size[0] == avalanche_size[1]);
+	}
+	for (long int n = 0; (n <= grid[0]->GetSize()) && success; ++n) {
+		success = (grid[0]->GetHeights()[n] == grid[1]->GetHeights()[n]);
+	}
+	cout << "Grid asking for " << page_type << ", on pages of " << (grid[1]->GetPageSize() >> 10) << " kB, "
+			<< "boundary " << boundary_type << ", " << layout << ": " << total
+			<< " topplings in total, " << (success ? "same" : "different") << endl;
+
+	for (int g = 0; g < G; ++g) {
+		delete toppling[g];
+		delete grid[g];
+	}
+	return success;
+}
+
+/**
+ * Drop grains on the same random spots of a grid with the dedicated BTW relaxation and of a
+ * packed lattice with dissipating boundaries. The dense threshold decides if the packed
+ * lattice topples cell by cell or with bitsliced sweeps. A width that is not a multiple of
+ * 64 checks the padding of the rows.
+ */
+bool ComparePacked(int width, int height, long int timespan, long int dense_threshold) {
+	SimulationContext context;
+	Grid<uint8_t> grid(width, height, BT_DISSIPATING, context);
+	Toppling<uint8_t> toppling(&grid);
+	toppling.SetTopplingMethod(Bak_Tang_Wiesenfeld1987);
+	toppling.SetTopplingIterator(FOLLOW_ACTIVITY);
+	toppling.SetDissipationAmount(-1);
+	PackedLattice lattice(width, height);
+	lattice.SetDenseThreshold(dense_threshold);
+
+	srand(238904);
+	bool success = true;
+	long int total = 0;
+	for (long int t = 0; (t < timespan) && success; ++t) {
+		int n = rand() % (width*height);
+		long int avalanche_size[2];
+		grid.Increase(n, 1);
+		toppling.CheckCell(n);
+		toppling.Topple(avalanche_size[0]);
+		lattice.Increase(n);
+		lattice.Relax(avalanche_size[1]);
+		total += avalanche_size[0];
+		if (avalanche_size[0] != avalanche_size[1]) {
+			cerr << "Avalanche " << t << " differs on packed lattice: "
+					<< avalanche_size[0] << " != " << avalanche_size[1] << endl;
+			success = false;
+		}
+	}
+	for (long int n = 0; (n < grid.GetSize()) && success; ++n) {
+		if (grid.GetHeights()[n] != lattice.GetValue(n)) {
+			cerr << "Height of cell " << n << " differs on packed lattice" << endl;
+			success = false;
+		}
+	}
+	if (lattice.CountGrains() + lattice.GetBoundaryOutflow() != timespan) {
+		cerr << "Grains are lost on packed lattice" << endl;
+		success = false;
+	}
+	cout << "Packed lattice, dense threshold " << dense_threshold << ": " << total
+			<< " topplings in total, " << (success ? "same" : "different") << endl;
+	return success;
+}
+
+/**
+ * Drop the grains of the 64 replicas of a replica lattice on 64 grids as well, and compare
+ * the avalanche sizes of every replica with those of its grid.
+ */
+bool CompareReplicas(int L, BoundaryType boundary_type, long int timespan) {
+	const int R = ReplicaLattice::Replicas;
+	ReplicaLattice lattice(L, boundary_type, std::vector<int>(NO_FEED_TYPES, 0));
+	Grid<uint8_t> *grid[R];
+	Toppling<uint8_t> *toppling[R];
+	SimulationContext context;
+	for (int b = 0; b < R; ++b) {
+		grid[b] = new Grid<uint8_t>(L, L, lattice.GetBoundaryType(), context);
+		toppling[b] = new Toppling<uint8_t>(grid[b]);
+		toppling[b]->SetTopplingMethod(Bak_Tang_Wiesenfeld1987);
+		toppling[b]->SetTopplingIterator(FOLLOW_ACTIVITY);
+		toppling[b]->SetDissipationAmount(-1);
+	}
+
+	bool success = true;
+	long int total = 0;
+	for (long int t = 0; (t < timespan) && success; ++t) {
+		lattice.Drive();
+		lattice.Relax();
+		for (int b = 0; b < R; ++b) {
+			long int n = lattice.GetDriveSite(b);
+			long int avalanche_size;
+			grid[b]->Increase(n, 1);
+			toppling[b]->CheckCell(n);
+			toppling[b]->Topple(avalanche_size);
+			total += avalanche_size;
+			if (avalanche_size != lattice.GetAvalancheSize(b)) {
+				cerr << "Avalanche " << t << " differs in replica " << b << ": "
+						<< avalanche_size << " != " << lattice.GetAvalancheSize(b) << endl;
+				success = false;
+			}
+		}
+	}
+	cout << "Replicas, boundary " << lattice.GetBoundaryType() << ": " << total
+			<< " topplings in total, " << (success ? "same" : "different") << endl;
+
+	for (int b = 0; b < R; ++b) {
+		delete toppling[b];
+		delete grid[b];
+	}
+	return success;
+}
+
+int main() {
+	int L = 32;
+	long int timespan = 20000;
+	bool success = true;
+	success &= Compare<double>(L, BT_DISSIPATING, timespan);
+	success &= Compare<double>(L, BT_PERIODIC, 2*L*L - L);
+	success &= Compare<double>(L, BT_WALL_DISSIPATING, timespan);
+	success &= Compare<double>(L, BT_CIRCULAR, timespan);
+	success &= Compare<uint8_t>(L, BT_DISSIPATING, timespan);
+	success &= Compare<uint8_t>(L, BT_WALL_DISSIPATING, timespan);
+	success &= Compare<int32_t>(L, BT_DISSIPATING, timespan, Manna_Lin2010);
+	success &= Compare<int32_t>(L, BT_CIRCULAR, timespan, Manna_Lin2010);
+	int M = 3*L+4;
+	success &= Compare<int32_t>(M, BT_PERIODIC, 2*M*M - M, Bak_Tang_Wiesenfeld1987, GL_TILED);
+	success &= Compare<int32_t>(M, BT_DISSIPATING, timespan, Manna_Lin2010, GL_TILED);
+	success &= CompareShape(L, BT_DISSIPATING, timespan);
+	success &= CompareShape(L, BT_PERIODIC, 2*L*L - L);
+	success &= CompareAllocation(8*L, BT_DISSIPATING, GL_ROW_MAJOR, PT_TRANSPARENT_HUGE);
+	success &= CompareAllocation(8*L+5, BT_PERIODIC, GL_TILED, PT_EXPLICIT_HUGE);
+	success &= ComparePacked(L, L, timespan, 0);
+	success &= ComparePacked(L, L, timespan, L*L);
+	success &= ComparePacked(3*L+5, L/2, timespan, 0);
+	success &= CompareReplicas(L/2, BT_DISSIPATING, timespan/10);
+	success &= CompareReplicas(L/2, BT_WALL_DISSIPATING, timespan/10);
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
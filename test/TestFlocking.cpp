@@ -57,18 +57,10 @@ int main(int argc, char* argv[]) {
 
 	config.Print();
 
-	if (config.feeds.size() >= 6) {
-		Toppling::SetGridFeed(config.feeds[0]);
-		Toppling::SetTopplingFeed(config.feeds[1]);
-		Cell::SetDirectionFeed(config.feeds[2]);
-		SandPile::SetDriveFeed(config.feeds[3]);
-		SandPile::SetDissipationFeed(config.feeds[4]);
-		Grid::SetNeighbourFeed(config.feeds[5]);
-	} else {
-		cerr << "Not enough feeds for random generators!" << endl;
-	}
+	SimulationContext context(config.feeds);
 
-	SandPile * sandpile = new SandPile(config.system_size, config.toppling_method, config.boundary_type);
+	SandPileBase * sandpile = SandPileBase::Create(context, config.height_type,
+			config.system_size, config.toppling_method, config.boundary_type);
 
 
 	assert (sandpile->GetDissToppling());
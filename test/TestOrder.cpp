@@ -39,7 +39,8 @@ int main() {
 	L = 256;
 	cout << "Create grid" << endl;
 	BoundaryType boundary_type = BT_PERIODIC;
-	Grid *grid = new Grid(L, L, boundary_type);
+	SimulationContext context;
+	Grid<GrainType> *grid = new Grid<GrainType>(L, L, boundary_type, context);
 
 	cout << "Create test class" << endl;
 	TestOrder order(grid);
@@ -53,7 +54,7 @@ int main() {
 	return EXIT_SUCCESS;
 }
 
-TestOrder::TestOrder(Grid *grid): TestCell(grid) {
+TestOrder::TestOrder(Grid<GrainType> *grid): TestCell(grid) {
 	grid_input = GI_RANDOM;
 	grid_input = GI_TWO_LINES;
 }
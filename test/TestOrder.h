@@ -24,7 +24,7 @@
 #ifndef TESTORDER_H_
 #define TESTORDER_H_
 
-class Grid;
+template <typename T> class Grid;
 #include <TestCell.h>
 
 enum GRID_INPUT { GI_LINE, GI_TWO_LINES, GI_RANDOM, GI_COUNT };
@@ -32,7 +32,7 @@ const std::string GRID_INPUTSTR[] = { "GI_LINE", "GI_TWO_LINES", "GI_RANDOM", "G
 
 class TestOrder: public TestCell {
 public:
-	TestOrder(Grid *grid);
+	TestOrder(Grid<GrainType> *grid);
 
 	~TestOrder();
 